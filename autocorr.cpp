@@ -0,0 +1,204 @@
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+#include "autocorr.h"
+
+/* Peaks weaker than this are noise */
+#define AUTOCORR_PEAK_MIN 0.1
+
+/* Local maxima looked at when picking periods */
+#define AUTOCORR_CANDIDATES 64
+
+/* A lag is put down to a shorter period that divides it if that period
+ * correlates at least this well relative to it.
+ */
+#define AUTOCORR_HARMONIC 0.8
+
+static int fft_size(int size)
+{
+	int n = 1;
+
+	// Twice the data, so the circular correlation doesn't wrap onto itself
+	while (n < 2 * size)
+		n <<= 1;
+	return n;
+}
+
+size_t autocorr_work_size(int size)
+{
+	return 2 * (size_t)fft_size(size);
+}
+
+/* In-place iterative radix-2 FFT over n interleaved complex values.
+ * sign is -1 forward and +1 inverse; the inverse isn't scaled.
+ */
+static void fft(double *x, int n, int sign)
+{
+	int i, j, len;
+
+	for (i = 1, j = 0; i < n; i++) {
+		int bit = n >> 1;
+		for (; j & bit; bit >>= 1)
+			j ^= bit;
+		j ^= bit;
+		if (i < j) {
+			double re = x[2 * i], im = x[2 * i + 1];
+			x[2 * i] = x[2 * j];
+			x[2 * i + 1] = x[2 * j + 1];
+			x[2 * j] = re;
+			x[2 * j + 1] = im;
+		}
+	}
+
+	for (len = 2; len <= n; len <<= 1) {
+		double angle = sign * 2 * M_PI / len;
+		double stepRe = cos(angle), stepIm = sin(angle);
+
+		for (i = 0; i < n; i += len) {
+			double wRe = 1.0, wIm = 0.0;
+			for (j = 0; j < len / 2; j++) {
+				double *a = x + 2 * (i + j);
+				double *b = x + 2 * (i + j + len / 2);
+				double tRe = b[0] * wRe - b[1] * wIm;
+				double tIm = b[0] * wIm + b[1] * wRe;
+				double next;
+
+				b[0] = a[0] - tRe;
+				b[1] = a[1] - tIm;
+				a[0] += tRe;
+				a[1] += tIm;
+
+				next = wRe * stepRe - wIm * stepIm;
+				wIm = wRe * stepIm + wIm * stepRe;
+				wRe = next;
+			}
+		}
+	}
+}
+
+/* Wiener-Khinchin: the autocorrelation is the inverse transform of the
+ * power spectrum.  O(n log n) rather than O(n^2) over every lag.
+ */
+int autocorrelate(const uint8_t *data, int size, double *corr, double *work)
+{
+	int n = fft_size(size);
+	double mean = 0.0;
+	int i;
+
+	if (size < 2 || size > AUTOCORR_MAX_BYTES)
+		return -1;
+
+	for (i = 0; i < size; i++)
+		mean += data[i];
+	mean /= size;
+
+	memset(work, 0, 2 * n * sizeof(*work));
+	for (i = 0; i < size; i++)
+		work[2 * i] = data[i] - mean;
+
+	fft(work, n, -1);
+	for (i = 0; i < n; i++) {
+		work[2 * i] = work[2 * i] * work[2 * i] + work[2 * i + 1] * work[2 * i + 1];
+		work[2 * i + 1] = 0.0;
+	}
+	fft(work, n, 1);
+
+	// Flat data correlates with nothing
+	if (work[0] <= 1e-9 * n) {
+		for (i = 0; i < size; i++)
+			corr[i] = 0.0;
+		corr[0] = 1.0;
+		return 0;
+	}
+
+	double variance = work[0] / size;
+	for (i = 0; i < size; i++)
+		corr[i] = work[2 * i] / (size - i) / variance;
+	return 0;
+}
+
+static int by_value(const void *a, const void *b)
+{
+	const struct autocorr_peak *pa = (const struct autocorr_peak *)a;
+	const struct autocorr_peak *pb = (const struct autocorr_peak *)b;
+
+	if (pa->value != pb->value)
+		return pa->value < pb->value ? 1 : -1;
+	return pa->lag - pb->lag;
+}
+
+/* A period of p correlates just as well at 2p, 3p and so on, and noise
+ * can make a multiple come out on top.  Walk a peak back to its smallest
+ * divisor that's nearly as strong.
+ */
+static struct autocorr_peak fundamental(const double *corr, struct autocorr_peak peak)
+{
+	int lag = peak.lag;
+
+	for (int d = 2; d * d <= lag; d++) {
+		if (lag % d)
+			continue;
+		if (corr[d] >= AUTOCORR_HARMONIC * peak.value) {
+			peak.lag = d;
+			peak.value = corr[d];
+			return peak;
+		}
+	}
+
+	for (int d = (int)sqrt((double)lag); d >= 2; d--) {
+		if (lag % d || lag / d == d)
+			continue;
+		if (corr[lag / d] >= AUTOCORR_HARMONIC * peak.value) {
+			peak.lag = lag / d;
+			peak.value = corr[lag / d];
+			return peak;
+		}
+	}
+
+	return peak;
+}
+
+/* Only lags up to half the buffer are considered, so every peak has
+ * seen at least two full repeats.
+ */
+int autocorr_peaks(const double *corr, int size, struct autocorr_peak *peaks, int max)
+{
+	struct autocorr_peak candidates[AUTOCORR_CANDIDATES];
+	int count = 0, found = 0;
+	int lag, i, j;
+
+	for (lag = 2; lag < size / 2; lag++) {
+		double value = corr[lag];
+		if (value < AUTOCORR_PEAK_MIN || value < corr[lag - 1] || value <= corr[lag + 1])
+			continue;
+
+		// Keep the strongest few, replacing the weakest once full
+		if (count < AUTOCORR_CANDIDATES) {
+			candidates[count].lag = lag;
+			candidates[count++].value = value;
+			continue;
+		}
+		int weakest = 0;
+		for (i = 1; i < count; i++)
+			if (candidates[i].value < candidates[weakest].value)
+				weakest = i;
+		if (value > candidates[weakest].value) {
+			candidates[weakest].lag = lag;
+			candidates[weakest].value = value;
+		}
+	}
+
+	qsort(candidates, count, sizeof(*candidates), by_value);
+
+	for (i = 0; i < count && found < max; i++) {
+		struct autocorr_peak peak = fundamental(corr, candidates[i]);
+		int repeat = 0;
+
+		for (j = 0; j < found && !repeat; j++)
+			repeat = peak.lag % peaks[j].lag == 0;
+		if (!repeat)
+			peaks[found++] = peak;
+	}
+
+	return found;
+}
@@ -0,0 +1,33 @@
+#ifndef AUTOCORR_H
+#define AUTOCORR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Longest buffer analysed; anything past this is ignored */
+#define AUTOCORR_MAX_BYTES 65536
+
+/* Periods reported at most */
+#define AUTOCORR_PEAKS_MAX 8
+
+struct autocorr_peak {
+	int lag;
+	double value;
+};
+
+/* Doubles of scratch space autocorrelate() needs for size bytes */
+size_t autocorr_work_size(int size);
+
+/* Autocorrelation of the bytes of data, mean removed, for every lag
+ * from 0 to size - 1.  Each lag is normalised by its overlap, so 1.0 is
+ * a perfect repeat and values near 0 mean no relation.  Returns -1 if
+ * size is out of range.
+ */
+int autocorrelate(const uint8_t *data, int size, double *corr, double *work);
+
+/* The strongest repeat periods in corr, strongest first, with multiples
+ * of a period already found left out.  Returns how many were found.
+ */
+int autocorr_peaks(const double *corr, int size, struct autocorr_peak *peaks, int max);
+
+#endif // AUTOCORR_H
@@ -0,0 +1,121 @@
+#include <QPainter>
+#include <QMouseEvent>
+#include <QToolTip>
+#include "autocorrview.h"
+
+AutocorrView::AutocorrView(QWidget *parent) :
+	QWidget(parent)
+{
+	setMouseTracking(true);
+}
+
+/* Cheap enough (a few ms for a 16 KB page) to redo on every selection
+ * change.  Scratch space is kept between calls.
+ */
+void AutocorrView::setData(const QByteArray &data)
+{
+	int size = qMin(data.size(), AUTOCORR_MAX_BYTES);
+	struct autocorr_peak found[AUTOCORR_PEAKS_MAX];
+
+	_peaks.clear();
+	_corr.resize(size);
+	if ((size_t)_work.size() < autocorr_work_size(size))
+		_work.resize(autocorr_work_size(size));
+
+	if (autocorrelate((const uint8_t *)data.constData(), size,
+					  _corr.data(), _work.data())) {
+		_corr.clear();
+		update();
+		return;
+	}
+
+	int count = autocorr_peaks(_corr.constData(), size, found, AUTOCORR_PEAKS_MAX);
+	for (int i = 0; i < count; i++)
+		_peaks.append(found[i]);
+	update();
+}
+
+const QVector<struct autocorr_peak> &AutocorrView::peaks() const
+{
+	return _peaks;
+}
+
+int AutocorrView::lags() const
+{
+	return _corr.size() / 2;
+}
+
+int AutocorrView::lagAt(int x) const
+{
+	if (lags() < 2 || x < 0 || x >= width())
+		return -1;
+	return 1 + (qint64)x * (lags() - 1) / width();
+}
+
+int AutocorrView::xForLag(int lag) const
+{
+	return (qint64)(lag - 1) * width() / qMax(1, lags() - 1);
+}
+
+/* One column per pixel, spanning the lowest and highest value of the
+ * lags that land in it.  Zero sits two thirds of the way down, as
+ * negative correlation is rarely interesting.
+ */
+void AutocorrView::paintEvent(QPaintEvent *)
+{
+	QPainter painter(this);
+	int w = width(), h = height();
+	int zero = h * 2 / 3;
+
+	if (lags() < 2) {
+		painter.drawText(rect(), Qt::AlignCenter, "Not enough data");
+		return;
+	}
+
+	painter.setPen(Qt::lightGray);
+	painter.drawLine(0, zero, w, zero);
+
+	painter.setPen(Qt::darkBlue);
+	for (int x = 0; x < w; x++) {
+		int first = lagAt(x);
+		int last = x == w - 1 ? lags() - 1 : qMax(first, lagAt(x + 1) - 1);
+		double low = _corr.at(first), high = low;
+		for (int lag = first + 1; lag <= last; lag++) {
+			low = qMin(low, _corr.at(lag));
+			high = qMax(high, _corr.at(lag));
+		}
+		painter.drawLine(x, zero - (int)(qBound(-0.5, low, 1.0) * zero),
+						 x, zero - (int)(qBound(-0.5, high, 1.0) * zero));
+	}
+
+	painter.setPen(Qt::red);
+	for (int i = 0; i < _peaks.count(); i++) {
+		int x = xForLag(_peaks.at(i).lag);
+		painter.drawLine(x, 0, x, h);
+		painter.drawText(x + 2, 12 * (i + 1), QString::number(_peaks.at(i).lag));
+	}
+}
+
+void AutocorrView::mouseMoveEvent(QMouseEvent *event)
+{
+	int lag = lagAt(event->pos().x());
+	if (lag < 0) {
+		QToolTip::hideText();
+		return;
+	}
+	QToolTip::showText(event->globalPos(),
+			QString("Lag %1: %2").arg(lag).arg(_corr.at(lag), 0, 'f', 3), this);
+}
+
+/* Clicking picks the lag under the pointer, or a marked period near it */
+void AutocorrView::mousePressEvent(QMouseEvent *event)
+{
+	int lag = lagAt(event->pos().x());
+	if (lag < 0)
+		return;
+
+	for (int i = 0; i < _peaks.count(); i++)
+		if (qAbs(xForLag(_peaks.at(i).lag) - event->pos().x()) <= 3)
+			lag = _peaks.at(i).lag;
+	emit lagClicked(lag);
+}
@@ -0,0 +1,37 @@
+#ifndef AUTOCORRVIEW_H
+#define AUTOCORRVIEW_H
+
+#include <QWidget>
+#include <QVector>
+#include "autocorr.h"
+
+/* Autocorrelation of a buffer against lag, with the strongest repeat
+ * periods marked.  Lags run up to half the buffer.
+ */
+class AutocorrView : public QWidget
+{
+	Q_OBJECT
+public:
+	explicit AutocorrView(QWidget *parent = 0);
+	void setData(const QByteArray &data);
+	const QVector<struct autocorr_peak> &peaks() const;
+
+signals:
+	void lagClicked(int lag);
+
+protected:
+	void paintEvent(QPaintEvent *event);
+	void mouseMoveEvent(QMouseEvent *event);
+	void mousePressEvent(QMouseEvent *event);
+
+private:
+	QVector<double> _corr;
+	QVector<double> _work;
+	QVector<struct autocorr_peak> _peaks;
+
+	int lags() const;
+	int lagAt(int x) const;
+	int xForLag(int lag) const;
+};
+
+#endif // AUTOCORRVIEW_H
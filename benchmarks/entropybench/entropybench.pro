@@ -0,0 +1,21 @@
+#-------------------------------------------------
+#
+# Entropy kernel microbenchmark
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = entropybench
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+SOURCES += main.cpp \
+    ../../entropy.cpp
+
+HEADERS  += ../../entropy.h
@@ -0,0 +1,89 @@
+/* Compare the Shannon entropy kernel against the old qCompress ratio
+ * on NAND-sized pages.  Run a release build.
+ */
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QByteArray>
+#include <QTextStream>
+#include <stdlib.h>
+#include "entropy.h"
+
+#define PAGES 256
+
+static qreal compression_ratio(const uint8_t *data, uint32_t size)
+{
+	if (size <= 2)
+		return 1;
+	QByteArray smaller = qCompress(data, size, 9);
+	qreal ratio = (smaller.size()*1.0)/(size*1.0);
+	if (ratio > 1.0)
+		ratio = 9999.0/10000.0;
+	return ratio;
+}
+
+/* A mix of the pages seen in real dumps: erased, sparse and scrambled */
+static QByteArray make_pages(int pageSize)
+{
+	QByteArray pages(pageSize * PAGES, 0);
+	uint8_t *p = (uint8_t *)pages.data();
+	int i;
+
+	srand(pageSize);
+	for (i = 0; i < pageSize * PAGES; i++) {
+		switch ((i / pageSize) % 3) {
+		case 0:
+			p[i] = 0xff;
+			break;
+		case 1:
+			p[i] = (rand() & 15) ? 0 : rand();
+			break;
+		default:
+			p[i] = rand();
+			break;
+		}
+	}
+	return pages;
+}
+
+static void run(QTextStream &out, int pageSize, int rounds)
+{
+	QByteArray pages = make_pages(pageSize);
+	const uint8_t *p = (const uint8_t *)pages.constData();
+	QElapsedTimer timer;
+	double sink = 0;
+	int r, i;
+
+	timer.start();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < PAGES; i++)
+			sink += shannon_entropy(p + i * pageSize, pageSize);
+	qint64 shannon = timer.nsecsElapsed();
+
+	timer.restart();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < PAGES; i++)
+			sink += compression_ratio(p + i * pageSize, pageSize);
+	qint64 compress = timer.nsecsElapsed();
+
+	qint64 n = (qint64)rounds * PAGES;
+	out << pageSize / 1024 << " KB pages: "
+		<< "shannon " << shannon / n / 1000.0 << " us/page, "
+		<< "qCompress " << compress / n / 1000.0 << " us/page, "
+		<< "speedup " << (double)compress / shannon << "x"
+		<< "  (" << sink << ")\n";
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication a(argc, argv);
+	QTextStream out(stdout);
+	int rounds = 4;
+
+	if (argc > 1)
+		rounds = atoi(argv[1]);
+
+	run(out, 4096, rounds);
+	run(out, 8192, rounds);
+	run(out, 16384, rounds);
+	return 0;
+}
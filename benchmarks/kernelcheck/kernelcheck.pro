@@ -0,0 +1,29 @@
+#-------------------------------------------------
+#
+# Self-checks for the scrambler and XOR kernels
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = kernelcheck
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+SOURCES += main.cpp \
+    ../../lfsr.cpp \
+    ../../keystream.cpp \
+    ../../xoralign.cpp \
+    ../../xorbytes.cpp \
+    ../../entropy.cpp
+
+HEADERS  += ../../lfsr.h \
+    ../../keystream.h \
+    ../../xoralign.h \
+    ../../xorbytes.h \
+    ../../entropy.h
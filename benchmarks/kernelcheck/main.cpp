@@ -0,0 +1,309 @@
+/* Check the scrambler and XOR search kernels against plain reference
+ * versions on synthetic pages.  Exits non-zero if anything disagrees.
+ */
+#include <QCoreApplication>
+#include <QByteArray>
+#include <QVector>
+#include <QTextStream>
+#include <stdlib.h>
+#include <math.h>
+#include "lfsr.h"
+#include "keystream.h"
+#include "xoralign.h"
+#include "xorbytes.h"
+
+static QTextStream out(stdout);
+static int failures;
+
+static void check(bool ok, const QString &what)
+{
+	if (ok)
+		return;
+	out << "FAIL: " << what << "\n";
+	failures++;
+}
+
+static QByteArray random_bytes(int size)
+{
+	QByteArray bytes(size, 0);
+	for (int i = 0; i < size; i++)
+		bytes[i] = rand();
+	return bytes;
+}
+
+static struct LfsrGenerator make_generator(int degree, quint32 poly, bool msbFirst)
+{
+	struct LfsrGenerator generator;
+	generator.degree = degree;
+	generator.poly = poly;
+	generator.msbFirst = msbFirst;
+	generator.seedRule = LFSR_SEED_TABLE;
+	generator.seedConstant = 0;
+	generator.pages = 0;
+	return generator;
+}
+
+/* The bit-sliced step against lfsr_keystream(), lane by lane, for every
+ * register of each short degree, in both bit orders.
+ */
+static void check_lfsr_slices(void)
+{
+	quint64 slices[64];
+	uint8_t bytes[8];
+	int checked = 0;
+
+	for (int degree = 2; degree <= 8; degree++) {
+		quint32 seeds = 1U << degree;
+		int lanes = qMin(64U, seeds);
+
+		for (quint32 poly = 1U << (degree - 1); poly < 1U << degree; poly++) {
+			for (quint32 base = 0; base < seeds; base += 64) {
+				lfsr_slice_outputs(degree, poly, base, slices, 64);
+
+				for (int msb = 0; msb < 2; msb++) {
+					struct LfsrGenerator generator = make_generator(degree, poly, msb);
+					for (int lane = 0; lane < lanes; lane++) {
+						bool same = true;
+						lfsr_keystream(generator, base + lane, bytes, sizeof(bytes));
+						for (int k = 0; k < 64; k++) {
+							int bit = (bytes[k / 8] >> (msb ? 7 - k % 8 : k % 8)) & 1;
+							same = same && (int)((slices[k] >> lane) & 1) == bit;
+						}
+						check(same, QString("lfsr slice degree %1 poly %2 seed %3 %4")
+							  .arg(degree).arg(poly, 0, 16).arg(base + lane)
+							  .arg(msb ? "msb" : "lsb"));
+						checked++;
+					}
+				}
+			}
+		}
+	}
+	out << "lfsr slices: " << checked << " lanes\n";
+}
+
+/* Scramble blank pages with a known register, flip a few bits, and make
+ * sure the search explains every page.
+ */
+static void check_lfsr_search(bool msbFirst)
+{
+	const int degree = 11, pageSize = 512, pageCount = 8;
+	const quint32 poly = 0x402, seedXor = 0x2a5;    // Maximal length
+	struct LfsrGenerator scrambler = make_generator(degree, poly, msbFirst);
+	QVector<QByteArray> data;
+	QVector<struct keystream_page> pages;
+	QAtomicInt cancel(0);
+	int i;
+
+	for (i = 0; i < pageCount; i++) {
+		int row = 100 + i;
+		QByteArray page(pageSize, 0);
+		lfsr_keystream(scrambler, row ^ seedXor, (uint8_t *)page.data(), page.size());
+		for (int b = 0; b < page.size(); b++)
+			page[b] = page.at(b) ^ 0xff;
+		data.append(page);
+	}
+
+	// Bit errors inside the prefilter's window, and one further on
+	data[0][0] = data.at(0).at(0) ^ 0x04;
+	data[3][2] = data.at(3).at(2) ^ 0x40;
+	data[5][100] = data.at(5).at(100) ^ 0x01;
+
+	for (i = 0; i < pageCount; i++) {
+		struct keystream_page page;
+		page.data = (const uint8_t *)data.at(i).constData();
+		page.size = data.at(i).size();
+		page.row = 100 + i;
+		pages.append(page);
+	}
+
+	struct lfsr_options options;
+	options.maxDegree = 12;
+	options.plaintext = 0xff;
+	options.cancel = &cancel;
+
+	struct LfsrGenerator found = make_generator(0, 0, false);
+	QString order = msbFirst ? "msb" : "lsb";
+	if (lfsr_search(pages, options, &found)) {
+		check(false, "lfsr search found nothing, " + order);
+		return;
+	}
+
+	check(found.degree <= degree, "lfsr search degree, " + order);
+	check(found.pages == pageCount, QString("lfsr search matched %1 of %2 pages, %3")
+		  .arg(found.pages).arg(pageCount).arg(order));
+
+	for (i = 0; i < pageCount; i++) {
+		QByteArray keystream(pageSize, 0);
+		quint32 seed;
+		int wrong = 0;
+
+		if (lfsr_seed_for_row(found, 100 + i, &seed)) {
+			check(false, QString("lfsr search no seed for row %1, %2").arg(100 + i).arg(order));
+			continue;
+		}
+		lfsr_keystream(found, seed, (uint8_t *)keystream.data(), keystream.size());
+		for (int b = 0; b < pageSize; b++)
+			wrong += ((uint8_t)keystream.at(b) ^ (uint8_t)data.at(i).at(b)) != 0xff;
+		check(wrong <= 1, QString("lfsr search row %1 off by %2 bytes, %3")
+			  .arg(100 + i).arg(wrong).arg(order));
+	}
+	out << "lfsr search " << order << ": degree " << found.degree
+		<< " poly " << QString::number(found.poly, 16) << "\n";
+}
+
+static quint64 square_sum(const QByteArray &data)
+{
+	quint64 hist[256] = { 0 };
+	quint64 score = 0;
+
+	for (int i = 0; i < data.size(); i++)
+		hist[(uint8_t)data.at(i)]++;
+	for (int i = 0; i < 256; i++)
+		score += hist[i] * hist[i];
+	return score;
+}
+
+/* xor_align_search() against patterning a copy at every shift */
+static void check_xor_align(int size, int patternSize, int shifts)
+{
+	QByteArray data(size, 0);
+	QByteArray pattern = random_bytes(patternSize);
+	QAtomicInt cancel(0);
+	struct xor_align_result result;
+	quint64 bestScore = 0;
+	int best = -1;
+
+	// Mostly small values, so some shifts clearly beat others
+	for (int i = 0; i < size; i++)
+		data[i] = (rand() & 7) ^ pattern.at(i % patternSize);
+
+	for (int shift = 0; shift < shifts && shift <= size; shift++) {
+		QByteArray copy = data;
+		xor_pattern((uint8_t *)copy.data() + shift, size - shift,
+					(const uint8_t *)pattern.constData(), patternSize);
+		quint64 score = square_sum(copy);
+		if (best < 0 || score > bestScore) {
+			best = shift;
+			bestScore = score;
+		}
+	}
+
+	QString what = QString("xor align size %1 pattern %2 shifts %3")
+			.arg(size).arg(patternSize).arg(shifts);
+	if (xor_align_search(data, pattern, shifts, &cancel, &result)) {
+		check(false, what + " failed");
+		return;
+	}
+
+	double chisq = bestScore / (size / 256.0) - size;
+	check(result.shift == best, what + QString(": shift %1, expected %2")
+		  .arg(result.shift).arg(best));
+	check(fabs(result.chisq - chisq) <= 1e-6 * qMax(1.0, chisq), what + ": chi-square");
+}
+
+/* Blank pages are the most common content at every position but well
+ * short of half, the rest being unrelated data.
+ */
+static void check_keystream_plurality(void)
+{
+	const int period = 3, pageSize = 1500, pageCount = 300;
+	QVector<QByteArray> streams, data;
+	QVector<struct keystream_page> pages;
+	QVector<int> perStream(period, 0);
+	struct Keystream keystream;
+	int i;
+
+	for (i = 0; i < period; i++)
+		streams.append(random_bytes(pageSize));
+
+	for (i = 0; i < pageCount; i++) {
+		int row = 1000 + i;
+		QByteArray page;
+		if (rand() % 100 < 35) {
+			page = streams.at(row % period);
+			for (int b = 0; b < page.size(); b++)
+				page[b] = page.at(b) ^ 0xff;
+		}
+		else {
+			page = random_bytes(pageSize);
+		}
+		// The odd short page
+		if (i % 50 == 7)
+			page.truncate(700);
+		data.append(page);
+		perStream[row % period]++;
+	}
+
+	for (i = 0; i < pageCount; i++) {
+		struct keystream_page page;
+		page.data = (const uint8_t *)data.at(i).constData();
+		page.size = data.at(i).size();
+		page.row = 1000 + i;
+		pages.append(page);
+	}
+
+	if (keystream_recover(pages, period, 0xff, &keystream)) {
+		check(false, "keystream plurality failed");
+		return;
+	}
+
+	qint64 total = 0;
+	for (i = 0; i < pageCount; i++)
+		total += data.at(i).size();
+	for (i = 0; i < period; i++) {
+		check(keystream.streams.at(i) == streams.at(i),
+			  QString("keystream plurality stream %1").arg(i));
+		check(keystream.pages.at(i) == perStream.at(i),
+			  QString("keystream plurality page count %1").arg(i));
+	}
+	check(keystream.total == total, "keystream plurality total");
+	check(keystream.agreeing * 2 < keystream.total, "keystream plurality agreement");
+	out << "keystream plurality: " << keystream.agreeing << " of "
+		<< keystream.total << " bytes agree\n";
+}
+
+/* More pages than a 16-bit counter holds, all the same */
+static void check_keystream_chunks(void)
+{
+	const int pageCount = 70000;
+	QByteArray page = random_bytes(4);
+	QVector<struct keystream_page> pages;
+	struct Keystream keystream;
+
+	for (int i = 0; i < pageCount; i++) {
+		struct keystream_page p;
+		p.data = (const uint8_t *)page.constData();
+		p.size = page.size();
+		p.row = -1;
+		pages.append(p);
+	}
+
+	if (keystream_recover(pages, 1, 0x00, &keystream)) {
+		check(false, "keystream chunks failed");
+		return;
+	}
+	check(keystream.streams.at(0) == page, "keystream chunks stream");
+	check(keystream.total == (qint64)pageCount * page.size(), "keystream chunks total");
+	check(keystream.agreeing == keystream.total, "keystream chunks agreement");
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication a(argc, argv);
+
+	srand(argc > 1 ? atoi(argv[1]) : 1);
+
+	check_lfsr_slices();
+	check_lfsr_search(false);
+	check_lfsr_search(true);
+
+	check_xor_align(4096, 7, 200);
+	check_xor_align(300, 16, 1000);
+	check_xor_align(1000, 1, 50);
+
+	check_keystream_plurality();
+	check_keystream_chunks();
+
+	out << (failures ? "FAILED" : "OK") << " (" << failures << " failures)\n";
+	return failures ? 1 : 0;
+}
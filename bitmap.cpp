@@ -0,0 +1,52 @@
+#include "bitmap.h"
+
+void bitmap_and(QVector<quint64> &dst, const QVector<quint64> &src)
+{
+	quint64 *d = dst.data();
+	const quint64 *s = src.constData();
+	int words = qMin(dst.count(), src.count());
+
+	for (int i = 0; i < words; i++)
+		d[i] &= s[i];
+}
+
+void bitmap_or(QVector<quint64> &dst, const QVector<quint64> &src)
+{
+	quint64 *d = dst.data();
+	const quint64 *s = src.constData();
+	int words = qMin(dst.count(), src.count());
+
+	for (int i = 0; i < words; i++)
+		d[i] |= s[i];
+}
+
+void bitmap_andnot(QVector<quint64> &dst, const QVector<quint64> &src)
+{
+	quint64 *d = dst.data();
+	const quint64 *s = src.constData();
+	int words = qMin(dst.count(), src.count());
+
+	for (int i = 0; i < words; i++)
+		d[i] &= ~s[i];
+}
+
+void bitmap_indices(const QVector<quint64> &bitmap, QVector<int> &indices)
+{
+	const quint64 *b = bitmap.constData();
+	int words = bitmap.count();
+	int count = 0;
+	int i;
+
+	for (i = 0; i < words; i++)
+		count += __builtin_popcountll(b[i]);
+
+	indices.resize(count);
+	int *out = indices.data();
+	for (i = 0; i < words; i++) {
+		quint64 word = b[i];
+		while (word) {
+			*out++ = (i << 6) + __builtin_ctzll(word);
+			word &= word - 1;
+		}
+	}
+}
@@ -0,0 +1,31 @@
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <QVector>
+
+/* Bitmaps hold one bit per event, 64 events to a word */
+#define BITMAP_WORDS(bits) (((bits) + 63) / 64)
+
+static inline void bitmap_set(QVector<quint64> &bitmap, int bit)
+{
+	bitmap[bit >> 6] |= Q_UINT64_C(1) << (bit & 63);
+}
+
+static inline bool bitmap_test(const QVector<quint64> &bitmap, int bit)
+{
+	return (bitmap.at(bit >> 6) >> (bit & 63)) & 1;
+}
+
+/* dst &= src */
+void bitmap_and(QVector<quint64> &dst, const QVector<quint64> &src);
+
+/* dst |= src */
+void bitmap_or(QVector<quint64> &dst, const QVector<quint64> &src);
+
+/* dst &= ~src */
+void bitmap_andnot(QVector<quint64> &dst, const QVector<quint64> &src);
+
+/* Replace indices with the position of every set bit, in ascending order */
+void bitmap_indices(const QVector<quint64> &bitmap, QVector<int> &indices);
+
+#endif // BITMAP_H
@@ -0,0 +1,159 @@
+#include <string.h>
+#include <math.h>
+#include "entropy.h"
+
+/* Byte histograms are built in four interleaved tables.  Runs of equal
+ * bytes (very common in NAND pages) would otherwise have every increment
+ * wait on the store of the one before it.  Data is loaded a word at a
+ * time and the tables are folded together at the end.
+ */
+void byte_histogram(const uint8_t *data, size_t size, uint32_t hist[256])
+{
+	uint32_t sub[4][256];
+	size_t i = 0;
+
+	memset(sub, 0, sizeof(sub));
+
+	for (; i + 16 <= size; i += 16) {
+		uint64_t lo, hi;
+		memcpy(&lo, data + i, sizeof(lo));
+		memcpy(&hi, data + i + 8, sizeof(hi));
+
+		sub[0][(uint8_t)(lo      )]++;
+		sub[1][(uint8_t)(lo >>  8)]++;
+		sub[2][(uint8_t)(lo >> 16)]++;
+		sub[3][(uint8_t)(lo >> 24)]++;
+		sub[0][(uint8_t)(lo >> 32)]++;
+		sub[1][(uint8_t)(lo >> 40)]++;
+		sub[2][(uint8_t)(lo >> 48)]++;
+		sub[3][(uint8_t)(lo >> 56)]++;
+
+		sub[0][(uint8_t)(hi      )]++;
+		sub[1][(uint8_t)(hi >>  8)]++;
+		sub[2][(uint8_t)(hi >> 16)]++;
+		sub[3][(uint8_t)(hi >> 24)]++;
+		sub[0][(uint8_t)(hi >> 32)]++;
+		sub[1][(uint8_t)(hi >> 40)]++;
+		sub[2][(uint8_t)(hi >> 48)]++;
+		sub[3][(uint8_t)(hi >> 56)]++;
+	}
+
+	for (; i < size; i++)
+		sub[i & 3][data[i]]++;
+
+	for (i = 0; i < 256; i++)
+		hist[i] = sub[0][i] + sub[1][i] + sub[2][i] + sub[3][i];
+}
+
+/* Each byte is loaded once and shifted into a running pair.  The table
+ * is far too big to keep several copies of as byte_histogram() does, but
+ * with 65536 bins back-to-back hits on one bin are rare outside runs of
+ * a single byte.
+ */
+void bigram_histogram(const uint8_t *data, size_t size, uint32_t *hist)
+{
+	uint32_t pair;
+	size_t i;
+
+	memset(hist, 0, 65536 * sizeof(*hist));
+	if (size < 2)
+		return;
+
+	pair = data[0];
+	for (i = 1; i < size; i++) {
+		pair = ((pair << 8) | data[i]) & 0xffff;
+		hist[pair]++;
+	}
+}
+
+/* H = log2(N) - (1/N) * sum(c * log2(c)) over non-empty bins */
+double histogram_entropy(const uint32_t hist[256], size_t total)
+{
+	double sum = 0.0;
+	int i;
+
+	if (!total)
+		return 0.0;
+
+	for (i = 0; i < 256; i++)
+		if (hist[i])
+			sum += hist[i] * log2((double)hist[i]);
+
+	double entropy = log2((double)total) - sum / total;
+	if (entropy < 0.0)
+		entropy = 0.0;
+	return entropy;
+}
+
+double shannon_entropy(const uint8_t *data, size_t size)
+{
+	uint32_t hist[256];
+
+	byte_histogram(data, size, hist);
+	return histogram_entropy(hist, size);
+}
+
+#define MONTE_RADIUS ((1ULL << 24) - 1)
+
+static inline int monte_hit(const uint8_t *p)
+{
+	uint64_t x = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+	uint64_t y = ((uint32_t)p[3] << 16) | ((uint32_t)p[4] << 8) | p[5];
+	return x * x + y * y <= MONTE_RADIUS * MONTE_RADIUS;
+}
+
+/* Works through 24 bytes at a time, which lines up with both the
+ * histogram's four tables and the six-byte Monte Carlo groups.  Each block
+ * is read from memory once and then picked over in registers / L1.  The
+ * serial products have no carried dependency inside a block, so the
+ * compiler can vectorise that loop.
+ */
+void byte_stats(const uint8_t *data, size_t size, struct byte_stats *stats)
+{
+	uint32_t sub[4][256];
+	uint64_t serial = 0;
+	uint64_t hits = 0;
+	uint32_t prev = 0;
+	size_t i = 0, j;
+
+	memset(sub, 0, sizeof(sub));
+
+	for (; i + 24 <= size; i += 24) {
+		const uint8_t *p = data + i;
+		uint32_t products = prev * p[0];
+
+		for (j = 0; j < 24; j += 4) {
+			sub[0][p[j    ]]++;
+			sub[1][p[j + 1]]++;
+			sub[2][p[j + 2]]++;
+			sub[3][p[j + 3]]++;
+		}
+
+		for (j = 0; j < 23; j++)
+			products += (uint32_t)p[j] * p[j + 1];
+		serial += products;
+		prev = p[23];
+
+		for (j = 0; j < 24; j += BYTE_STATS_MONTE)
+			hits += monte_hit(p + j);
+	}
+
+	for (j = i; j + BYTE_STATS_MONTE <= size; j += BYTE_STATS_MONTE)
+		hits += monte_hit(data + j);
+
+	for (; i < size; i++) {
+		sub[i & 3][data[i]]++;
+		serial += prev * data[i];
+		prev = data[i];
+	}
+
+	if (size)
+		serial += prev * data[0];
+
+	for (i = 0; i < 256; i++)
+		stats->hist[i] = sub[0][i] + sub[1][i] + sub[2][i] + sub[3][i];
+	stats->total = size;
+	stats->serial = serial;
+	stats->monte_tries = size / BYTE_STATS_MONTE;
+	stats->monte_hits = hits;
+}
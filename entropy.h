@@ -0,0 +1,35 @@
+#ifndef ENTROPY_H
+#define ENTROPY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Count occurrences of each byte value.  hist is overwritten. */
+void byte_histogram(const uint8_t *data, size_t size, uint32_t hist[256]);
+
+/* Shannon entropy of a byte histogram, in bits per byte (0 - 8) */
+double histogram_entropy(const uint32_t hist[256], size_t total);
+
+/* Shannon entropy of a buffer, in bits per byte (0 - 8) */
+double shannon_entropy(const uint8_t *data, size_t size);
+
+/* Count each pair of adjacent bytes, first byte in the high half of the
+ * bin number.  hist holds 65536 bins and is overwritten.
+ */
+void bigram_histogram(const uint8_t *data, size_t size, uint32_t *hist);
+
+/* Monte Carlo pi takes six bytes at a time as two 24-bit co-ordinates */
+#define BYTE_STATS_MONTE 6
+
+/* Everything the analysis panes want from a buffer, gathered in one pass */
+struct byte_stats {
+	uint32_t hist[256];
+	uint64_t total;
+	uint64_t serial;        // Sum of data[i] * data[i + 1], last byte wraps to first
+	uint64_t monte_tries;
+	uint64_t monte_hits;    // Tries landing inside the circle
+};
+
+void byte_stats(const uint8_t *data, size_t size, struct byte_stats *stats);
+
+#endif // ENTROPY_H
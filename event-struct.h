@@ -46,12 +46,33 @@ struct evt_file_header {
     uint8_t magic1[4];
     uint32_t version;
     uint32_t count;
-    uint32_t reserved1;
+    uint32_t metadata;  // Offset of the evt_metadata table (version >= 3)
     uint32_t reserved2;
     uint32_t reserved3;
     uint32_t reserved4;
 } MY_PACK;
 
+#define EVENT_FILE_VERSION 1
+// Version 2 stored entropy as a compression ratio; its tables are ignored
+#define EVENT_FILE_VERSION_METADATA 3
+
+enum evt_metadata_flags {
+    EVT_META_HAS_DATA    = 1,
+    EVT_META_HAS_ADDRESS = 2,
+    EVT_META_ERASED      = 4,
+};
+
+// Derived per-event values, stored as one record per event in a table
+// appended after the events.  Computed once at import time.
+struct evt_metadata {
+    uint32_t entropy;   // Bits per byte, 16.16 fixed point
+    uint32_t hash;      // FNV-1a hash of the payload
+    uint32_t row;       // NAND row address (24 bits)
+    uint16_t column;    // NAND column address
+    uint8_t  flags;     // evt_metadata_flags
+    uint8_t  reserved;
+} MY_PACK;
+
 struct evt_header {
     uint8_t type;
     uint32_t sec_start, nsec_start;
@@ -2,20 +2,26 @@
 #include <QTextStream>
 #include "event.h"
 #include "byteswap.h"
+#include "eventmetrics.h"
 
 static QList<QString> eventTypes;
 
-
-static qreal getEntropy(QByteArray &data)
+class EventData : public QSharedData
 {
-	if (data.size() <= 2)
-		return 1;
-	QByteArray smaller = qCompress(data, 9);
-	qreal ratio = (smaller.size()*1.0)/(data.size()*1.0);
-	if (ratio > 1.0)
-		ratio = 9999.0/10000.0;
-	return ratio;
-}
+public:
+	/* Header fields, unpacked into host byte order */
+	uint8_t type;
+	uint32_t secStart, nsecStart;
+	uint32_t secEnd, nsecEnd;
+
+	/* The packet exactly as stored, and a view onto its payload */
+	QByteArray raw;
+	QByteArray data;
+
+	int index;
+	mutable struct evt_metadata metadata;
+	mutable bool metadataValid;
+};
 
 QList<QString> &EventTypes()
 {
@@ -87,55 +93,66 @@ static qint64 streamReadData(QIODevice &source, char *data, qint64 bytesTotal) {
 }
 
 
-Event::Event(QObject *parent) :
-    QObject(parent)
+/* Does the packet extend far enough to hold this field? */
+#define PACKET_HAS(field) \
+	((const char *)&packet()->field + sizeof(packet()->field) \
+		<= d->raw.constData() + d->raw.size())
+
+Event::Event() :
+	d(new EventData)
 {
-	memset(&evt, 0, sizeof(evt));
+	decodeEvent();
 }
 
-Event::Event(QIODevice &source, QObject *parent) :
-	QObject(parent)
+Event::Event(QIODevice &source) :
+	d(new EventData)
 {
+	struct evt_header header;
 	qint64 bytesRead;
 
-	memset(&evt, 0, sizeof(evt));
-	bytesRead = streamReadData(source, (char *)(&evt.header), sizeof(evt.header));
-	if (bytesRead != sizeof(evt.header)) {
-		qDebug() << "Read an unexpected number of bytes:" << bytesRead << "vs" << sizeof(evt.header);
+	memset(&header, 0, sizeof(header));
+	bytesRead = streamReadData(source, (char *)&header, sizeof(header));
+	if (bytesRead != sizeof(header)) {
+		qDebug() << "Read an unexpected number of bytes:" << bytesRead << "vs" << sizeof(header);
 	}
-	if (_ntohl(evt.header.size) > sizeof(evt)) {
-		qDebug() << "Header size is VERY wrong:" << _ntohl(evt.header.size);
+	if (_ntohl(header.size) < sizeof(header)) {
+		qDebug() << "Header size is VERY wrong:" << _ntohl(header.size);
+		header.size = _htonl(sizeof(header));
 	}
 
+	d->raw.resize(_ntohl(header.size));
+	memcpy(d->raw.data(), &header, sizeof(header));
 	bytesRead = streamReadData(source,
-                               ((char *)(&evt.header)) + sizeof(evt.header),
-                               _ntohl(evt.header.size) - sizeof(evt.header));
+							   d->raw.data() + sizeof(header),
+							   d->raw.size() - sizeof(header));
 	decodeEvent();
 }
 
-Event::Event(QByteArray &data, QObject *parent) :
-	QObject(parent)
+Event::Event(const QByteArray &data) :
+	d(new EventData)
 {
-	memset(&evt, 0, sizeof(evt));
-	size_t size = data.length();
-	if (size > sizeof(evt))
-		size = sizeof(evt);
-	memcpy(&evt, data, size);
+	int size = data.size();
+	if (size >= (int)sizeof(struct evt_header)) {
+		const struct evt_header *header = (const struct evt_header *)data.constData();
+		if (_ntohl(header->size) < (uint32_t)size)
+			size = _ntohl(header->size);
+	}
+	d->raw = QByteArray(data.constData(), size);
 	decodeEvent();
 }
 
-Event::Event(const Event &other, QObject *parent) :
-	QObject(parent)
+Event::Event(const Event &other) :
+	d(other.d)
+{
+}
+
+Event::~Event()
 {
-    memcpy(&evt, &other.evt, sizeof(evt));
-	decodeEvent();
-	setIndex(other.eventIndex);
 }
 
 Event &Event::operator=(const Event &other)
 {
-    memcpy(&evt, &other.evt, sizeof(evt));
-	decodeEvent();
+	d = other.d;
     return *this;
 }
 
@@ -151,234 +168,306 @@ bool Event::operator<(const Event &other) const
     return false;
 }
 
+/* Unpack the header and locate the payload.  Everything else is read
+ * out of the packet buffer when it's asked for.
+ */
 void Event::decodeEvent() {
+	const uint8_t *payload;
+	uint32_t payloadSize;
 
-	_entropy = 1.0;
-
-    nandIdString = "";
-    if (eventType() == EVT_NAND_ID) {
-        int i;
-        for (i=0; i<evt.nand_id.size; i++) {
-            if (i>0)
-                nandIdString += " ";
-            nandIdString += QString("%1").arg(evt.nand_id.id[i], 2, 16, QChar('0'));
-        }
-    }
-
-    _netCmd = "";
-    if (eventType() == EVT_NET_CMD) {
-        _netCmd.append(evt.net_cmd.cmd[0]);
-        _netCmd.append(evt.net_cmd.cmd[1]);
-    }
-
-	_nandReadColumnAddr = "";
-    _nandReadRowAddr = "";
-	if (eventType() == EVT_NAND_CHANGE_READ_COLUMN) {
-        _nandReadColumnAddr = QString("%1 %2").arg(evt.nand_change_read_coumn.addr[1], 2, 16, QChar('0')).arg(evt.nand_change_read_coumn.addr[0], 2, 16, QChar('0'));
-        _nandReadRowAddr = QString("%1 %2 %3").arg(evt.nand_change_read_coumn.addr[4], 2, 16, QChar('0')).arg(evt.nand_change_read_coumn.addr[3], 2, 16, QChar('0')).arg(evt.nand_change_read_coumn.addr[2], 2, 16, QChar('0'));
-        _data.resize(_ntohl(evt.nand_change_read_coumn.count));
-		memcpy(_data.data(), evt.nand_change_read_coumn.data, _ntohl(evt.nand_change_read_coumn.count));
-		_entropy = getEntropy(_data);
-	}
-
-	if (eventType() == EVT_NAND_READ) {
-        _nandReadColumnAddr = QString("%1 %2").arg(evt.nand_change_read_coumn.addr[1], 2, 16, QChar('0')).arg(evt.nand_change_read_coumn.addr[0], 2, 16, QChar('0'));
-        _nandReadRowAddr = QString("%1 %2 %3").arg(evt.nand_change_read_coumn.addr[4], 2, 16, QChar('0')).arg(evt.nand_change_read_coumn.addr[3], 2, 16, QChar('0')).arg(evt.nand_change_read_coumn.addr[2], 2, 16, QChar('0'));
-        _data.resize(_ntohl(evt.nand_read.count));
-		memcpy(_data.data(), evt.nand_read.data, _ntohl(evt.nand_read.count));
-		_entropy = getEntropy(_data);
-	}
-
-	if (eventType() == EVT_NAND_DATA) {
-		_nandReadColumnAddr = QString("%1 %2").arg(evt.nand_data.addr[1], 2, 16, QChar('0')).arg(evt.nand_change_read_coumn.addr[0], 2, 16, QChar('0'));
-		_nandReadRowAddr = QString("%1 %2 %3").arg(evt.nand_data.addr[4], 2, 16, QChar('0')).arg(evt.nand_change_read_coumn.addr[3], 2, 16, QChar('0')).arg(evt.nand_change_read_coumn.addr[2], 2, 16, QChar('0'));
-		_data.resize(_ntohl(evt.nand_data.count));
-		memcpy(_data.data(), evt.nand_data.data, _ntohl(evt.nand_data.count));
-		_entropy = getEntropy(_data);
-	}
+	d->metadataValid = false;
+	d->index = 0;
 
-	if (eventType() == EVT_NAND_PARAMETER_READ) {
-		_data.resize(_ntohs(evt.nand_parameter_read.count));
-		memcpy(_data.data(), evt.nand_parameter_read.data, _ntohs(evt.nand_parameter_read.count));
-		_entropy = getEntropy(_data);
+	// Anything too short to hold a header is treated as an empty unknown event
+	if (d->raw.size() < (int)sizeof(struct evt_header)) {
+		d->raw.fill(0, sizeof(struct evt_header));
+		d->raw[0] = EVT_UNKNOWN;
 	}
 
-    _sandiskChargeAddr = "";
-	if (eventType() == EVT_NAND_SANDISK_CHARGE1) {
-        _sandiskChargeAddr = QString("%1 %2 %3").arg(evt.nand_sandisk_charge1.addr[2], 2, 16, QChar('0')).arg(evt.nand_sandisk_charge1.addr[1], 2, 16, QChar('0')).arg(evt.nand_sandisk_charge1.addr[0], 2, 16, QChar('0'));
-	}
-	else if (eventType() == EVT_NAND_SANDISK_CHARGE2) {
-		for (unsigned int i=0; i<sizeof(evt.nand_sandisk_charge2.addr); i++) {
-			if (i>0)
-				_sandiskChargeAddr += " ";
-			_sandiskChargeAddr += QString("%1").arg(evt.nand_sandisk_charge2.addr[i], 2, 16, QChar('0'));
-		}
-	}
+	d->type = packet()->header.type;
+	d->secStart = _ntohl(packet()->header.sec_start);
+	d->nsecStart = _ntohl(packet()->header.nsec_start);
+	d->secEnd = _ntohl(packet()->header.sec_end);
+	d->nsecEnd = _ntohl(packet()->header.nsec_end);
 
-	_sdArgs = "";
-	if (eventType() == EVT_SD_CMD) {
-		_sdArgs = "";
-        for (unsigned int i=0; i<_ntohl(evt.sd_cmd.num_args); i++) {
-			if (i>0)
-				_sdArgs += " ";
-			_sdArgs += QString("%1").arg(evt.sd_cmd.args[i], 2, 16, QChar('0'));
-		}
-		_data.resize(_ntohl(evt.sd_cmd.num_results));
-		memcpy(_data.data(), evt.sd_cmd.result, _ntohl(evt.sd_cmd.num_results));
-		_entropy = getEntropy(_data);
-	}
+	payloadSize = event_payload(packet(), d->raw.size(), &payload);
+	if (payloadSize)
+		d->data = QByteArray::fromRawData((const char *)payload, payloadSize);
+	else
+		d->data = QByteArray();
+}
 
-	_dataAsByteArray.setRawData((char *)&evt, _ntohl(evt.header.size));
+const union evt *Event::packet() const
+{
+	return (const union evt *)d->raw.constData();
 }
 
 uint32_t Event::nanoSecondsStart() const {
-	return _ntohl(evt.header.nsec_start);
+	return d->nsecStart;
 }
 
 uint32_t Event::secondsStart() const {
-	return _ntohl(evt.header.sec_start);
+	return d->secStart;
 }
 
 uint32_t Event::nanoSecondsEnd() const {
-	return _ntohl(evt.header.nsec_end);
+	return d->nsecEnd;
 }
 
 uint32_t Event::secondsEnd() const {
-	return _ntohl(evt.header.sec_end);
+	return d->secEnd;
 }
 
 uint32_t Event::eventSize() const {
-	return _ntohl(evt.header.size);
+	return d->raw.size();
 }
 
 enum evt_type Event::eventType() const {
-    return (enum evt_type)evt.header.type;
+    return (enum evt_type)d->type;
 }
 
 const QString &Event::eventTypeStr() const {
-	if (evt.header.type > EventTypes().count())
+	if (d->type >= EventTypes().count())
 		return EventTypes()[0];
-    return EventTypes()[evt.header.type];
+    return EventTypes()[d->type];
 }
 
-const QString &Event::netCmd() const {
-    return _netCmd;
+QString Event::netCmd() const {
+	QString cmd;
+	if (d->type == EVT_NET_CMD && PACKET_HAS(net_cmd.cmd)) {
+		cmd.append(packet()->net_cmd.cmd[0]);
+		cmd.append(packet()->net_cmd.cmd[1]);
+	}
+	return cmd;
 }
 
 uint32_t Event::netArg() const {
-    return evt.net_cmd.arg;
+	if (!PACKET_HAS(net_cmd.arg))
+		return 0;
+    return packet()->net_cmd.arg;
 }
 
 int Event::setIndex(int index)
 {
     int o = index;
-	this->eventIndex = index;
+	d->index = index;
     return o;
 }
 
-int Event::index()
+int Event::index() const
 {
-	return eventIndex;
+	return d->index;
 }
 
 uint8_t Event::helloVersion() const
 {
-    return evt.hello.version;
+	if (!PACKET_HAS(hello.version))
+		return 0;
+    return packet()->hello.version;
 }
 
 uint8_t Event::nandIdAddr() const
 {
-	return evt.nand_id.addr;
+	if (!PACKET_HAS(nand_id.addr))
+		return 0;
+	return packet()->nand_id.addr;
 }
 
-const QString &Event::nandIdValue() const
+QString Event::nandIdValue() const
 {
+	QString nandIdString;
+	if (d->type != EVT_NAND_ID || !PACKET_HAS(nand_id.id))
+		return nandIdString;
+
+	for (int i=0; i<packet()->nand_id.size && i<(int)sizeof(packet()->nand_id.id); i++) {
+		if (i>0)
+			nandIdString += " ";
+		nandIdString += QString("%1").arg(packet()->nand_id.id[i], 2, 16, QChar('0'));
+	}
     return nandIdString;
 }
 
 const QByteArray &Event::data() const
 {
-	return _data;
+	return d->data;
 }
 
 int Event::rawPacketSize() const
 {
-	return _dataAsByteArray.size();
+	return d->raw.size();
 }
 
 const QByteArray &Event::rawPacket() const
 {
-	return _dataAsByteArray;
+	return d->raw;
 }
 
 uint8_t Event::nandSakdiskParamAddr() const
 {
-	return evt.nand_unk_sandisk_param.addr;
+	if (!PACKET_HAS(nand_unk_sandisk_param.addr))
+		return 0;
+	return packet()->nand_unk_sandisk_param.addr;
 }
 
 uint8_t Event::nandSandiskParamData() const
 {
-	return evt.nand_unk_sandisk_param.data;
+	if (!PACKET_HAS(nand_unk_sandisk_param.data))
+		return 0;
+	return packet()->nand_unk_sandisk_param.data;
 }
 
 uint8_t Event::nandStatus() const
 {
-	return evt.nand_status.status;
+	if (!PACKET_HAS(nand_status.status))
+		return 0;
+	return packet()->nand_status.status;
 }
 
 uint8_t Event::nandParameterAddr() const
 {
-	return evt.nand_parameter_read.addr;
+	if (!PACKET_HAS(nand_parameter_read.addr))
+		return 0;
+	return packet()->nand_parameter_read.addr;
 }
 
-const QString &Event::nandSandiskChargeAddr() const
+QString Event::nandSandiskChargeAddr() const
 {
-	return _sandiskChargeAddr;
+	QString chargeAddr;
+	if (!PACKET_HAS(nand_sandisk_charge1.addr))
+		return chargeAddr;
+
+	if (d->type == EVT_NAND_SANDISK_CHARGE1) {
+		const uint8_t *addr = packet()->nand_sandisk_charge1.addr;
+        chargeAddr = QString("%1 %2 %3").arg(addr[2], 2, 16, QChar('0')).arg(addr[1], 2, 16, QChar('0')).arg(addr[0], 2, 16, QChar('0'));
+	}
+	else if (d->type == EVT_NAND_SANDISK_CHARGE2) {
+		for (unsigned int i=0; i<sizeof(packet()->nand_sandisk_charge2.addr); i++) {
+			if (i>0)
+				chargeAddr += " ";
+			chargeAddr += QString("%1").arg(packet()->nand_sandisk_charge2.addr[i], 2, 16, QChar('0'));
+		}
+	}
+	return chargeAddr;
+}
+
+bool Event::hasNandAddress() const
+{
+	return (d->type == EVT_NAND_READ
+		 || d->type == EVT_NAND_CHANGE_READ_COLUMN
+		 || d->type == EVT_NAND_DATA)
+		&& PACKET_HAS(nand_read.addr);
+}
+
+QString Event::nandReadColumnAddr() const
+{
+	if (!hasNandAddress())
+		return QString();
+	return QString("%1 %2").arg(nandColumn() >> 8, 2, 16, QChar('0')).arg(nandColumn() & 0xff, 2, 16, QChar('0'));
+}
+
+QString Event::nandReadRowAddr() const
+{
+	if (!hasNandAddress())
+		return QString();
+	return QString("%1 %2 %3").arg(nandRow() >> 16, 2, 16, QChar('0')).arg((nandRow() >> 8) & 0xff, 2, 16, QChar('0')).arg(nandRow() & 0xff, 2, 16, QChar('0'));
 }
 
-const QString &Event::nandReadColumnAddr() const
+uint32_t Event::nandRow() const
 {
-    return _nandReadColumnAddr;
+	if (!hasNandAddress())
+		return 0;
+	return (packet()->nand_read.addr[4] << 16)
+		 | (packet()->nand_read.addr[3] << 8)
+		 | packet()->nand_read.addr[2];
 }
 
-const QString &Event::nandReadRowAddr() const
+uint16_t Event::nandColumn() const
 {
-    return _nandReadRowAddr;
+	if (!hasNandAddress())
+		return 0;
+	return (packet()->nand_read.addr[1] << 8) | packet()->nand_read.addr[0];
 }
 
 uint8_t Event::sdCmdCMD() const
 {
-	return evt.sd_cmd.cmd & 0x3f;
+	if (!PACKET_HAS(sd_cmd.cmd))
+		return 0;
+	return packet()->sd_cmd.cmd & 0x3f;
 }
 
 bool Event::sdCmdIsACMD() const
 {
-	return evt.sd_cmd.cmd&0x80;
+	if (!PACKET_HAS(sd_cmd.cmd))
+		return false;
+	return packet()->sd_cmd.cmd&0x80;
 }
 
-const QString &Event::sdCmdArgs() const
+QString Event::sdCmdArgs() const
 {
-	return _sdArgs;
+	QString sdArgs;
+	if (d->type != EVT_SD_CMD || !PACKET_HAS(sd_cmd.num_args))
+		return sdArgs;
+
+	const uint8_t *args = packet()->sd_cmd.args;
+	uint32_t count = qMin(_ntohl(packet()->sd_cmd.num_args),
+						  (uint32_t)sizeof(packet()->sd_cmd.args));
+	for (unsigned int i=0; i<count && (const char *)&args[i] < d->raw.constData() + d->raw.size(); i++) {
+		if (i>0)
+			sdArgs += " ";
+		sdArgs += QString("%1").arg(args[i], 2, 16, QChar('0'));
+	}
+	return sdArgs;
 }
 
 uint8_t Event::nandUnknownControl() const
 {
-	return evt.nand_unk.ctrl;
+	if (!PACKET_HAS(nand_unk.ctrl))
+		return 0;
+	return packet()->nand_unk.ctrl;
 }
 
 uint8_t Event::nandUnknownData() const
 {
-	return evt.nand_unk.data;
+	if (!PACKET_HAS(nand_unk.data))
+		return 0;
+	return packet()->nand_unk.data;
 }
 
 uint16_t Event::nandUnknownPins() const
 {
-	return evt.nand_unk.unknown;
+	if (!PACKET_HAS(nand_unk.unknown))
+		return 0;
+	return packet()->nand_unk.unknown;
+}
+
+const struct evt_metadata &Event::metadata() const
+{
+	if (!d->metadataValid) {
+		event_compute_metrics(packet(), d->raw.size(), &d->metadata);
+		d->metadataValid = true;
+	}
+	return d->metadata;
+}
+
+void Event::setMetadata(const struct evt_metadata &metadata)
+{
+	d->metadata = metadata;
+	d->metadataValid = true;
 }
 
 qreal Event::entropy() const
 {
-	return _entropy;
+	return metadata().entropy / 65536.0;
+}
+
+uint32_t Event::payloadHash() const
+{
+	return metadata().hash;
+}
+
+bool Event::isErased() const
+{
+	return metadata().flags & EVT_META_ERASED;
 }
 
 QDebug operator<<(QDebug dbg, const Event &e)
@@ -484,5 +573,5 @@ QDebug operator<<(QDebug dbg, const Event &e)
 }
 
 qint64 Event::write(QIODevice &device) {
-	return device.write((const char *)&evt, eventSize());
+	return device.write(d->raw);
 }
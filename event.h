@@ -1,7 +1,7 @@
 #ifndef EVENT_H
 #define EVENT_H
 
-#include <QObject>
+#include <QSharedDataPointer>
 #include <QIODevice>
 #include <QDateTime>
 #include <stdint.h>
@@ -13,16 +13,18 @@
 
 QList<QString> &EventTypes();
 
-class Event : public QObject
+class EventData;
+
+/* An event is implicitly shared, so copies are cheap */
+class Event
 {
-    Q_OBJECT
 public:
-    explicit Event(QObject *parent = 0);
-	Event(QIODevice &source, QObject *parent = 0);
-	Event(QByteArray &data, QObject *parent = 0);
+    Event();
+	Event(QIODevice &source);
+	Event(const QByteArray &data);
 
-    Event() {}
-    Event(const Event &other, QObject *parent = 0);
+    Event(const Event &other);
+    ~Event();
     Event &operator=(const Event &other);
     bool operator<(const Event &other) const;
 	void decodeEvent();
@@ -38,7 +40,7 @@ public:
 
 	enum evt_type eventType() const;
 	const QString &eventTypeStr() const;
-	int index();
+	int index() const;
 	int setIndex(int index);
 
     /* Hello Stream functions */
@@ -46,19 +48,30 @@ public:
 
 	/* NAND ID command */
 	uint8_t nandIdAddr() const;
-	const QString &nandIdValue() const;
+	QString nandIdValue() const;
 
-	/* NAND Change Read Column or NAND Read */
+	/* NAND Change Read Column or NAND Read.  data() is a view into the
+	 * event's packet, so copy it if it needs to outlive the event.
+	 */
 	const QByteArray &data() const;
-    const QString &nandReadRowAddr() const;
-    const QString &nandReadColumnAddr() const;
+	bool hasNandAddress() const;
+    QString nandReadRowAddr() const;
+    QString nandReadColumnAddr() const;
+	uint32_t nandRow() const;
+	uint16_t nandColumn() const;
 
     /* Network command */
-    const QString &netCmd() const;
+    QString netCmd() const;
     uint32_t netArg() const;
 
-	/* If there's data, how random is it? */
+	/* If there's data, how random is it?  Bits per byte, 0 - 8 */
 	qreal entropy() const;
+	uint32_t payloadHash() const;
+	bool isErased() const;
+
+	/* Derived values, either loaded from the event file or computed on demand */
+	const struct evt_metadata &metadata() const;
+	void setMetadata(const struct evt_metadata &metadata);
 
 	/* Sandisk vendor param */
 	uint8_t nandSakdiskParamAddr() const;
@@ -75,12 +88,12 @@ public:
 	uint8_t nandParameterAddr() const;
 
 	/* Misc. Sandisk commands */
-	const QString &nandSandiskChargeAddr() const;
+	QString nandSandiskChargeAddr() const;
 
 	/* SD Commands */
 	bool sdCmdIsACMD() const;
 	uint8_t sdCmdCMD() const;
-	const QString &sdCmdArgs() const;
+	QString sdCmdArgs() const;
 
 	/* NAND unknown packet */
 	uint8_t nandUnknownData() const;
@@ -88,24 +101,13 @@ public:
 	uint16_t nandUnknownPins() const;
 
 private:
-    union evt evt;
-	QByteArray _dataAsByteArray;
-	int eventIndex;
-    QString nandIdString;
-	QByteArray _data;
-    QString _netCmd;
-	QString _sandiskChargeAddr;
-    QString _nandReadRowAddr;
-	QString _nandReadColumnAddr;
-	QString _sdArgs;
-	double _entropy;
-
-signals:
-    
-public slots:
-    
+	QSharedDataPointer<EventData> d;
+
+	const union evt *packet() const;
 };
 
+Q_DECLARE_TYPEINFO(Event, Q_MOVABLE_TYPE);
+
 QDebug operator<<(QDebug dbg, const Event &p);
 
 #endif // EVENT_H
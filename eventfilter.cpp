@@ -0,0 +1,767 @@
+#include <QtConcurrentMap>
+#include <QVarLengthArray>
+#include <QDebug>
+#include <limits>
+#include <ctype.h>
+#include <math.h>
+#include "eventfilter.h"
+#include "bitmap.h"
+#include "event.h"
+
+/* Filters are evaluated over this many events at a time.  Must be a
+ * multiple of 64.
+ */
+#define FILTER_CHUNK_SIZE 16384
+
+enum filter_field {
+	FIELD_TYPE,
+	FIELD_INDEX,
+	FIELD_START,
+	FIELD_END,
+	FIELD_DURATION,
+	FIELD_SIZE,
+	FIELD_CE,
+	FIELD_ROW,
+	FIELD_COLUMN,
+	FIELD_ENTROPY,
+};
+
+enum filter_op {
+	NODE_AND,
+	NODE_OR,
+	NODE_RANGE,
+};
+
+/* Every comparison is turned into an inclusive range check.  "not" is
+ * pushed down to the ranges while parsing, so a negated range still
+ * only matches events that have a value for its field.
+ */
+struct filter_node {
+	int op;
+	int field;
+	qint64 lo, hi;
+	float flo, fhi;
+	bool negate;                // Known values outside lo..hi
+	struct filter_node *left, *right;
+};
+
+static const struct {
+	const char *name;
+	int field;
+} filter_fields[] = {
+	{"type",     FIELD_TYPE},
+	{"index",    FIELD_INDEX},
+	{"time",     FIELD_START},
+	{"start",    FIELD_START},
+	{"end",      FIELD_END},
+	{"duration", FIELD_DURATION},
+	{"size",     FIELD_SIZE},
+	{"ce",       FIELD_CE},
+	{"row",      FIELD_ROW},
+	{"column",   FIELD_COLUMN},
+	{"col",      FIELD_COLUMN},
+	{"entropy",  FIELD_ENTROPY},
+	{NULL,       0},
+};
+
+enum filter_token {
+	TOK_END,
+	TOK_IDENT,
+	TOK_NUMBER,
+	TOK_LPAREN,
+	TOK_RPAREN,
+	TOK_AND,
+	TOK_OR,
+	TOK_NOT,
+	TOK_IN,
+	TOK_RANGE,
+	TOK_EQ,
+	TOK_NE,
+	TOK_LT,
+	TOK_LE,
+	TOK_GT,
+	TOK_GE,
+	TOK_ERROR,
+};
+
+struct filter_parser {
+	QString text;
+	int pos;
+	int token;
+	QString ident;
+	double number;      // Seconds, if hasUnit is set
+	bool hasUnit;
+	QString error;
+};
+
+
+static void free_node(struct filter_node *node)
+{
+	if (!node)
+		return;
+	free_node(node->left);
+	free_node(node->right);
+	delete node;
+}
+
+static struct filter_node *new_node(int op)
+{
+	struct filter_node *node = new struct filter_node;
+	node->op = op;
+	node->field = 0;
+	node->lo = node->hi = 0;
+	node->flo = node->fhi = 0;
+	node->negate = false;
+	node->left = node->right = NULL;
+	return node;
+}
+
+/* not(a and b) is (not a) or (not b), and so on down to the ranges */
+static struct filter_node *negate_node(struct filter_node *node)
+{
+	switch (node->op) {
+	case NODE_AND:
+	case NODE_OR:
+		node->op = node->op == NODE_AND ? NODE_OR : NODE_AND;
+		negate_node(node->left);
+		negate_node(node->right);
+		break;
+	case NODE_RANGE:
+		node->negate = !node->negate;
+		break;
+	}
+	return node;
+}
+
+static void parse_error(struct filter_parser *p, const QString &message)
+{
+	if (p->error.isEmpty())
+		p->error = message;
+	p->token = TOK_ERROR;
+}
+
+static bool is_time_field(int field)
+{
+	return field == FIELD_START || field == FIELD_END || field == FIELD_DURATION;
+}
+
+
+/* Tokenizer */
+
+static void lex_number(struct filter_parser *p)
+{
+	const QString &t = p->text;
+	int start = p->pos;
+	bool negative = false;
+	bool ok;
+
+	if (t.at(p->pos) == '-') {
+		negative = true;
+		p->pos++;
+	}
+
+	if (t.mid(p->pos, 2).toLower() == "0x") {
+		int digits = p->pos += 2;
+		while (p->pos < t.length() && isxdigit(t.at(p->pos).toLatin1()))
+			p->pos++;
+		p->number = t.mid(digits, p->pos - digits).toLongLong(&ok, 16);
+		if (negative)
+			p->number = -p->number;
+	}
+	else {
+		while (p->pos < t.length() && t.at(p->pos).isDigit())
+			p->pos++;
+		// A lone '.' is a decimal point, ".." is a range
+		if (p->pos + 1 < t.length() && t.at(p->pos) == '.' && t.at(p->pos + 1).isDigit()) {
+			p->pos++;
+			while (p->pos < t.length() && t.at(p->pos).isDigit())
+				p->pos++;
+		}
+		p->number = t.mid(start, p->pos - start).toDouble(&ok);
+	}
+
+	if (!ok) {
+		parse_error(p, QString("Bad number \"%1\"").arg(t.mid(start, p->pos - start)));
+		return;
+	}
+
+	p->hasUnit = false;
+	int unitStart = p->pos;
+	while (p->pos < t.length() && t.at(p->pos).isLetter())
+		p->pos++;
+	QString unit = t.mid(unitStart, p->pos - unitStart);
+	if (unit.isEmpty())
+		return;
+
+	p->hasUnit = true;
+	if (unit == "s")
+		;
+	else if (unit == "ms")
+		p->number /= 1e3;
+	else if (unit == "us")
+		p->number /= 1e6;
+	else if (unit == "ns")
+		p->number /= 1e9;
+	else
+		parse_error(p, QString("Unknown unit \"%1\"").arg(unit));
+}
+
+static void next_token(struct filter_parser *p)
+{
+	const QString &t = p->text;
+
+	if (p->token == TOK_ERROR)
+		return;
+
+	while (p->pos < t.length() && t.at(p->pos).isSpace())
+		p->pos++;
+
+	if (p->pos >= t.length()) {
+		p->token = TOK_END;
+		return;
+	}
+
+	QChar c = t.at(p->pos);
+	QChar n = p->pos + 1 < t.length() ? t.at(p->pos + 1) : QChar();
+
+	if (c.isDigit() || (c == '-' && n.isDigit())) {
+		p->token = TOK_NUMBER;
+		lex_number(p);
+		return;
+	}
+
+	if (c.isLetter() || c == '_') {
+		int start = p->pos;
+		while (p->pos < t.length() && (t.at(p->pos).isLetterOrNumber() || t.at(p->pos) == '_'))
+			p->pos++;
+		p->ident = t.mid(start, p->pos - start);
+
+		QString lower = p->ident.toLower();
+		if (lower == "and")
+			p->token = TOK_AND;
+		else if (lower == "or")
+			p->token = TOK_OR;
+		else if (lower == "not")
+			p->token = TOK_NOT;
+		else if (lower == "in")
+			p->token = TOK_IN;
+		else
+			p->token = TOK_IDENT;
+		return;
+	}
+
+	p->pos++;
+	if (c == '(')
+		p->token = TOK_LPAREN;
+	else if (c == ')')
+		p->token = TOK_RPAREN;
+	else if (c == '&' && n == '&')
+		p->pos++, p->token = TOK_AND;
+	else if (c == '|' && n == '|')
+		p->pos++, p->token = TOK_OR;
+	else if (c == '.' && n == '.')
+		p->pos++, p->token = TOK_RANGE;
+	else if (c == '=' && n == '=')
+		p->pos++, p->token = TOK_EQ;
+	else if (c == '=')
+		p->token = TOK_EQ;
+	else if (c == '!' && n == '=')
+		p->pos++, p->token = TOK_NE;
+	else if (c == '!')
+		p->token = TOK_NOT;
+	else if (c == '<' && n == '=')
+		p->pos++, p->token = TOK_LE;
+	else if (c == '<')
+		p->token = TOK_LT;
+	else if (c == '>' && n == '=')
+		p->pos++, p->token = TOK_GE;
+	else if (c == '>')
+		p->token = TOK_GT;
+	else
+		parse_error(p, QString("Unexpected \"%1\"").arg(c));
+}
+
+
+/* Parser */
+
+static struct filter_node *parse_or(struct filter_parser *p);
+
+static int lookup_type(const QString &name)
+{
+	QString upper = name.toUpper();
+	int i;
+
+	if (!upper.startsWith("EVT_"))
+		upper.prepend("EVT_");
+	for (i = 0; i < EventTypes().count(); i++)
+		if (EventTypes().at(i) == upper)
+			return i;
+	return -1;
+}
+
+/* Read a value for field, converted to the units the table stores */
+static int parse_value(struct filter_parser *p, int field, double *value)
+{
+	if (p->token == TOK_NUMBER) {
+		if (p->hasUnit && !is_time_field(field)) {
+			parse_error(p, "Only times take a unit");
+			return -1;
+		}
+		*value = p->number;
+		if (is_time_field(field))
+			*value *= 1e9;
+		next_token(p);
+		return 0;
+	}
+
+	if (p->token == TOK_IDENT && field == FIELD_TYPE) {
+		int type = lookup_type(p->ident);
+		if (type < 0) {
+			parse_error(p, QString("Unknown event type \"%1\"").arg(p->ident));
+			return -1;
+		}
+		*value = type;
+		next_token(p);
+		return 0;
+	}
+
+	parse_error(p, "Expected a value");
+	return -1;
+}
+
+static qint64 clamp_bound(double value)
+{
+	if (value >= 9.2e18)
+		return std::numeric_limits<qint64>::max();
+	if (value <= -9.2e18)
+		return std::numeric_limits<qint64>::min();
+	return (qint64)value;
+}
+
+/* Turn "field op value" into an inclusive range.  != is not(==). */
+static struct filter_node *range_node(int field, int op, double lo, double hi)
+{
+	struct filter_node *node = new_node(NODE_RANGE);
+	node->field = field;
+	node->lo = std::numeric_limits<qint64>::min();
+	node->hi = std::numeric_limits<qint64>::max();
+	node->flo = -INFINITY;
+	node->fhi = INFINITY;
+
+	switch (op) {
+	case TOK_EQ:
+	case TOK_NE:
+	case TOK_IN:
+		node->lo = clamp_bound(ceil(lo));
+		node->hi = clamp_bound(floor(hi));
+		node->flo = lo;
+		node->fhi = hi;
+		break;
+	case TOK_LT:
+		node->hi = clamp_bound(ceil(hi) - 1);
+		node->fhi = nextafterf(hi, -INFINITY);
+		break;
+	case TOK_LE:
+		node->hi = clamp_bound(floor(hi));
+		node->fhi = hi;
+		break;
+	case TOK_GT:
+		node->lo = clamp_bound(floor(lo) + 1);
+		node->flo = nextafterf(lo, INFINITY);
+		break;
+	case TOK_GE:
+		node->lo = clamp_bound(ceil(lo));
+		node->flo = lo;
+		break;
+	}
+
+	if (op == TOK_NE)
+		return negate_node(node);
+	return node;
+}
+
+static struct filter_node *parse_comparison(struct filter_parser *p)
+{
+	double lo, hi;
+	int field = -1;
+	int op, i;
+
+	if (p->token != TOK_IDENT) {
+		parse_error(p, "Expected a field name");
+		return NULL;
+	}
+
+	for (i = 0; filter_fields[i].name; i++)
+		if (p->ident.toLower() == filter_fields[i].name)
+			field = filter_fields[i].field;
+	if (field < 0) {
+		parse_error(p, QString("Unknown field \"%1\"").arg(p->ident));
+		return NULL;
+	}
+	next_token(p);
+
+	op = p->token;
+	if (op < TOK_IN || op > TOK_GE || op == TOK_RANGE) {
+		parse_error(p, "Expected a comparison");
+		return NULL;
+	}
+	next_token(p);
+
+	if (parse_value(p, field, &lo))
+		return NULL;
+	hi = lo;
+
+	if (op == TOK_IN) {
+		if (p->token != TOK_RANGE) {
+			parse_error(p, "Expected \"..\"");
+			return NULL;
+		}
+		next_token(p);
+		if (parse_value(p, field, &hi))
+			return NULL;
+	}
+
+	return range_node(field, op, lo, hi);
+}
+
+static struct filter_node *parse_unary(struct filter_parser *p)
+{
+	if (p->token == TOK_NOT) {
+		next_token(p);
+		struct filter_node *child = parse_unary(p);
+		if (!child)
+			return NULL;
+		return negate_node(child);
+	}
+
+	if (p->token == TOK_LPAREN) {
+		next_token(p);
+		struct filter_node *node = parse_or(p);
+		if (!node)
+			return NULL;
+		if (p->token != TOK_RPAREN) {
+			free_node(node);
+			parse_error(p, "Expected \")\"");
+			return NULL;
+		}
+		next_token(p);
+		return node;
+	}
+
+	return parse_comparison(p);
+}
+
+static struct filter_node *parse_binary(struct filter_parser *p, int token, int op,
+										struct filter_node *(*parse_child)(struct filter_parser *))
+{
+	struct filter_node *left = parse_child(p);
+
+	while (left && p->token == token) {
+		next_token(p);
+		struct filter_node *right = parse_child(p);
+		if (!right) {
+			free_node(left);
+			return NULL;
+		}
+		struct filter_node *node = new_node(op);
+		node->left = left;
+		node->right = right;
+		left = node;
+	}
+	return left;
+}
+
+static struct filter_node *parse_and(struct filter_parser *p)
+{
+	return parse_binary(p, TOK_AND, NODE_AND, parse_unary);
+}
+
+static struct filter_node *parse_or(struct filter_parser *p)
+{
+	return parse_binary(p, TOK_OR, NODE_OR, parse_and);
+}
+
+
+/* Evaluation.  Each kernel fills the bitmap words for events first to
+ * last-1, where first is a multiple of 64.  Bits past last are cleared.
+ */
+
+template <typename T>
+static void range_kernel(const T *col, int first, int last, T lo, T hi, quint64 *out)
+{
+	int i = first;
+
+	for (; i + 64 <= last; i += 64) {
+		quint64 word = 0;
+		for (int b = 0; b < 64; b++)
+			word |= (quint64)((col[i + b] >= lo) & (col[i + b] <= hi)) << b;
+		*out++ = word;
+	}
+
+	if (i < last) {
+		quint64 word = 0;
+		for (int b = 0; i + b < last; b++)
+			word |= (quint64)((col[i + b] >= lo) & (col[i + b] <= hi)) << b;
+		*out = word;
+	}
+}
+
+/* Narrow the bounds to the column's type first, so the comparisons run
+ * at the column's width.
+ */
+template <typename T>
+static void column_range(const QVector<T> &col, int first, int last,
+						 qint64 lo, qint64 hi, quint64 *out)
+{
+	if (lo > (qint64)std::numeric_limits<T>::max()
+	 || hi < (qint64)std::numeric_limits<T>::min()
+	 || lo > hi) {
+		memset(out, 0, BITMAP_WORDS(last - first) * sizeof(*out));
+		return;
+	}
+	lo = qMax(lo, (qint64)std::numeric_limits<T>::min());
+	hi = qMin(hi, (qint64)std::numeric_limits<T>::max());
+	range_kernel<T>(col.constData(), first, last, (T)lo, (T)hi, out);
+}
+
+static void duration_range(const struct EventTable &t, int first, int last,
+						   qint64 lo, qint64 hi, quint64 *out)
+{
+	const qint64 *start = t.start.constData();
+	const qint64 *end = t.end.constData();
+
+	memset(out, 0, BITMAP_WORDS(last - first) * sizeof(*out));
+	for (int i = first; i < last; i++) {
+		qint64 duration = end[i] - start[i];
+		out[(i - first) >> 6] |= (quint64)((duration >= lo) & (duration <= hi)) << ((i - first) & 63);
+	}
+}
+
+static void index_range(int first, int last, qint64 lo, qint64 hi, quint64 *out)
+{
+	memset(out, 0, BITMAP_WORDS(last - first) * sizeof(*out));
+	lo = qMax(lo, (qint64)first);
+	hi = qMin(hi, (qint64)last - 1);
+	for (qint64 i = lo; i <= hi; i++)
+		out[(i - first) >> 6] |= Q_UINT64_C(1) << ((i - first) & 63);
+}
+
+static void in_range(const struct filter_node *node, const struct EventTable &t,
+					 int first, int last, quint64 *out)
+{
+	switch (node->field) {
+	case FIELD_TYPE:
+		column_range(t.type, first, last, node->lo, node->hi, out);
+		break;
+	case FIELD_INDEX:
+		index_range(first, last, node->lo, node->hi, out);
+		break;
+	case FIELD_START:
+		column_range(t.start, first, last, node->lo, node->hi, out);
+		break;
+	case FIELD_END:
+		column_range(t.end, first, last, node->lo, node->hi, out);
+		break;
+	case FIELD_DURATION:
+		duration_range(t, first, last, node->lo, node->hi, out);
+		break;
+	case FIELD_SIZE:
+		column_range(t.size, first, last, node->lo, node->hi, out);
+		break;
+	case FIELD_CE:
+		column_range(t.ce, first, last, node->lo, node->hi, out);
+		break;
+	case FIELD_ROW:
+		column_range(t.row, first, last, node->lo, node->hi, out);
+		break;
+	case FIELD_COLUMN:
+		column_range(t.column, first, last, node->lo, node->hi, out);
+		break;
+	case FIELD_ENTROPY:
+		range_kernel<float>(t.entropy.constData(), first, last, node->flo, node->fhi, out);
+		break;
+	}
+}
+
+/* Events that have a value for field.  Rows, columns and chip enables
+ * are -1 when unknown, and entropy is 0 for events without a payload.
+ * Returns false if every event has one.
+ */
+static bool known_values(int field, const struct EventTable &t, int first, int last,
+						 quint64 *out)
+{
+	const qint64 max = std::numeric_limits<qint64>::max();
+
+	switch (field) {
+	case FIELD_CE:
+		column_range(t.ce, first, last, 0, max, out);
+		return true;
+	case FIELD_ROW:
+		column_range(t.row, first, last, 0, max, out);
+		return true;
+	case FIELD_COLUMN:
+		column_range(t.column, first, last, 0, max, out);
+		return true;
+	case FIELD_ENTROPY:
+		column_range(t.size, first, last, 1, max, out);
+		return true;
+	}
+	return false;
+}
+
+static void eval_range(const struct filter_node *node, const struct EventTable &t,
+					   int first, int last, quint64 *out)
+{
+	int words = BITMAP_WORDS(last - first);
+	QVarLengthArray<quint64, FILTER_CHUNK_SIZE / 64> known(words);
+	int i;
+
+	in_range(node, t, first, last, out);
+	if (node->negate) {
+		for (i = 0; i < words; i++)
+			out[i] = ~out[i];
+		if ((last - first) & 63)
+			out[words - 1] &= (Q_UINT64_C(1) << ((last - first) & 63)) - 1;
+	}
+
+	if (known_values(node->field, t, first, last, known.data()))
+		for (i = 0; i < words; i++)
+			out[i] &= known[i];
+}
+
+static void eval_node(const struct filter_node *node, const struct EventTable &t,
+					  int first, int last, quint64 *out)
+{
+	int words = BITMAP_WORDS(last - first);
+	int i;
+
+	switch (node->op) {
+	case NODE_RANGE:
+		eval_range(node, t, first, last, out);
+		break;
+
+	case NODE_AND:
+	case NODE_OR: {
+		QVarLengthArray<quint64, FILTER_CHUNK_SIZE / 64> other(words);
+		quint64 any = 0;
+
+		eval_node(node->left, t, first, last, out);
+		for (i = 0; i < words; i++)
+			any |= out[i];
+		// Nothing left to narrow down
+		if (node->op == NODE_AND && !any)
+			break;
+
+		eval_node(node->right, t, first, last, other.data());
+		if (node->op == NODE_AND)
+			for (i = 0; i < words; i++)
+				out[i] &= other[i];
+		else
+			for (i = 0; i < words; i++)
+				out[i] |= other[i];
+		break;
+	}
+	}
+}
+
+struct filter_chunk {
+	const struct filter_node *root;
+	const struct EventTable *table;
+	quint64 *matches;
+	int first;
+	int last;
+};
+
+static void eval_chunk(struct filter_chunk &chunk)
+{
+	quint64 *out = chunk.matches + (chunk.first >> 6);
+	int count = chunk.last - chunk.first;
+
+	if (chunk.root) {
+		eval_node(chunk.root, *chunk.table, chunk.first, chunk.last, out);
+		return;
+	}
+
+	memset(out, 0xff, BITMAP_WORDS(count) * sizeof(*out));
+	if (count & 63)
+		out[BITMAP_WORDS(count) - 1] = (Q_UINT64_C(1) << (count & 63)) - 1;
+}
+
+
+EventFilter::EventFilter() :
+	_root(NULL)
+{
+}
+
+EventFilter::~EventFilter()
+{
+	free_node(_root);
+}
+
+int EventFilter::parse(const QString &text)
+{
+	struct filter_parser p;
+	struct filter_node *root = NULL;
+
+	p.text = text;
+	p.pos = 0;
+	p.token = TOK_END;
+	p.number = 0;
+	p.hasUnit = false;
+	next_token(&p);
+
+	if (p.token != TOK_END) {
+		root = parse_or(&p);
+		if (root && p.token != TOK_END) {
+			parse_error(&p, "Expected \"and\" or \"or\"");
+			free_node(root);
+			root = NULL;
+		}
+		if (!root) {
+			if (p.error.isEmpty())
+				p.error = "Syntax error";
+			_error = QString("%1 at column %2").arg(p.error).arg(p.pos + 1);
+			return -1;
+		}
+	}
+
+	free_node(_root);
+	_root = root;
+	_error.clear();
+	return 0;
+}
+
+const QString &EventFilter::errorString() const
+{
+	return _error;
+}
+
+bool EventFilter::isEmpty() const
+{
+	return !_root;
+}
+
+void EventFilter::evaluate(const struct EventTable &table, int first, int last,
+						   QVector<quint64> &matches) const
+{
+	QVector<struct filter_chunk> chunks;
+
+	// Work in whole words; events just before first are re-evaluated
+	first &= ~63;
+	if (first >= last)
+		return;
+	if (matches.count() < BITMAP_WORDS(last))
+		matches.resize(BITMAP_WORDS(last));
+
+	for (; first < last; first += FILTER_CHUNK_SIZE) {
+		struct filter_chunk chunk;
+		chunk.root = _root;
+		chunk.table = &table;
+		chunk.matches = matches.data();
+		chunk.first = first;
+		chunk.last = qMin(first + FILTER_CHUNK_SIZE, last);
+		chunks.append(chunk);
+	}
+
+	QtConcurrent::blockingMap(chunks, eval_chunk);
+}
@@ -0,0 +1,50 @@
+#ifndef EVENTFILTER_H
+#define EVENTFILTER_H
+
+#include <QString>
+#include <QVector>
+#include "eventtable.h"
+
+struct filter_node;
+
+/* A parsed filter expression, such as
+ *
+ *   type == NAND_READ and row in 0x1200..0x12ff
+ *       and time >= 3.1 and time < 4.0 and entropy < 6
+ *
+ * Fields are type, index, time (or start), end, duration, size, ce,
+ * row, column (or col) and entropy.  Times are in seconds, or take a
+ * s/ms/us/ns suffix.  Comparisons are ==, !=, <, <=, >, >= and
+ * "in lo..hi"; they combine with and/or/not, &&/||/! and parentheses.
+ *
+ * Events without a value for a field never match a comparison on it:
+ * ce, row and column are unknown on events that don't carry them, and
+ * entropy on events with no payload.  "not" and != only apply to known
+ * values, so "not row in 0..0xff" leaves out events with no address.
+ */
+class EventFilter
+{
+public:
+	EventFilter();
+	~EventFilter();
+
+	/* Returns 0 on success.  An empty expression matches everything. */
+	int parse(const QString &text);
+	const QString &errorString() const;
+	bool isEmpty() const;
+
+	/* Set or clear the bit in matches for each event first to last-1.
+	 * Runs across all cores.
+	 */
+	void evaluate(const struct EventTable &table, int first, int last,
+				  QVector<quint64> &matches) const;
+
+private:
+	struct filter_node *_root;
+	QString _error;
+
+	EventFilter(const EventFilter &);
+	EventFilter &operator=(const EventFilter &);
+};
+
+#endif // EVENTFILTER_H
@@ -0,0 +1,91 @@
+#include <QPainter>
+#include <QApplication>
+#include "eventitemdelegate.h"
+#include "eventsort.h"
+
+EventItemDelegate::EventItemDelegate(QObject *parent) :
+	QStyledItemDelegate(parent)
+{
+	qreal onS = .95;
+	qreal offS = .13;
+	qreal onV = .83;
+	qreal offV = .98;
+	qreal colors[] = {
+		.1,
+		.4,
+		.8,
+		.6,
+		.33,
+	};
+
+	_entropyColor = QColor::fromRgb(255, 128, 128);
+	_sizeColor = QColor::fromHsvF(.13, .34, .93);
+	_pinBorder = QColor::fromRgb(192, 192, 192);
+	for (int i=0; i<NAND_PIN_COUNT; i++) {
+		_pinOn[i] = QColor::fromHsvF(colors[i], onS, onV);
+		_pinOff[i] = QColor::fromHsvF(colors[i], offS, offV);
+	}
+}
+
+/* Row background and selection come from the style as usual, then the
+ * bars, then the label on top.
+ */
+void EventItemDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option,
+							  const QModelIndex &index) const
+{
+	// Only the type column has bars
+	if (index.column() != EVENT_COLUMN_TYPE) {
+		QStyledItemDelegate::paint(painter, option, index);
+		return;
+	}
+
+	painter->save();
+
+	QStyleOptionViewItemV4 opt(option);
+	initStyleOption(&opt, index);
+	const QWidget *widget = opt.widget;
+	QStyle *style = widget ? widget->style() : QApplication::style();
+	QString text = opt.text;
+	const QRect &rect = opt.rect;
+
+	opt.text = QString();
+	style->drawControl(QStyle::CE_ItemViewItem, &opt, painter, widget);
+
+	QVariant pins = index.data(EventItemModel::PinsRole);
+	if (pins.isValid()) {
+		int top = rect.top() + 4;
+		int left = rect.left() + 120;
+		int height = 8;
+		int width = 14;
+		int value = pins.toInt();
+
+		painter->setPen(_pinBorder);
+		for (int i=0; i<NAND_PIN_COUNT; i++) {
+			painter->drawRect(left, top-1, width+1, height+1);
+			left++;
+			painter->fillRect(left, top, width, height,
+							  (value & (1 << i)) ? _pinOn[i] : _pinOff[i]);
+			left += 20;
+		}
+	}
+	else {
+		QVariant entropyBar = index.data(EventItemModel::EntropyBarRole);
+		QVariant sizeBar = index.data(EventItemModel::SizeBarRole);
+		int half = rect.height() / 2;
+		if (entropyBar.isValid())
+			painter->fillRect(rect.left(), rect.top(),
+							  qMin(entropyBar.toInt(), rect.width()), half, _entropyColor);
+		if (sizeBar.isValid())
+			painter->fillRect(rect.left(), rect.top() + half,
+							  qMin(sizeBar.toInt(), rect.width()), rect.height() - half, _sizeColor);
+	}
+
+	QPalette::ColorGroup group = (opt.state & QStyle::State_Enabled)
+			? QPalette::Normal : QPalette::Disabled;
+	QRect textRect = style->subElementRect(QStyle::SE_ItemViewItemText, &opt, widget);
+	painter->setPen(opt.palette.color(group, (opt.state & QStyle::State_Selected)
+			? QPalette::HighlightedText : QPalette::Text));
+	painter->drawText(textRect, opt.displayAlignment, text);
+
+	painter->restore();
+}
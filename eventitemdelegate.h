@@ -0,0 +1,28 @@
+#ifndef EVENTITEMDELEGATE_H
+#define EVENTITEMDELEGATE_H
+
+#include <QStyledItemDelegate>
+#include <QColor>
+#include "eventitemmodel.h"
+
+/* Draws the event list's entropy and size bars and the raw bus pin
+ * boxes straight into the view, from values EventItemModel works out
+ * as events load.
+ */
+class EventItemDelegate : public QStyledItemDelegate
+{
+	Q_OBJECT
+public:
+	explicit EventItemDelegate(QObject *parent = 0);
+	void paint(QPainter *painter, const QStyleOptionViewItem &option,
+			   const QModelIndex &index) const;
+
+private:
+	QColor _entropyColor;
+	QColor _sizeColor;
+	QColor _pinBorder;
+	QColor _pinOn[NAND_PIN_COUNT];
+	QColor _pinOff[NAND_PIN_COUNT];
+};
+
+#endif // EVENTITEMDELEGATE_H
@@ -1,26 +1,93 @@
 
 #include <QDebug>
 #include <QSize>
-#include <QColor>
-#include <QBrush>
-#include <QPainter>
+#include <QtAlgorithms>
 #include "eventitemmodel.h"
 #include "nand.h"
+#include "eventsort.h"
+
+/* Filter changes touching more separate runs of rows than this are
+ * announced as one layout change instead of a remove or insert per run.
+ */
+#define FILTER_MAX_RUNS 64
+
+/* Longest bar EventItemDelegate draws, in pixels */
+#define BAR_WIDTH_MAX 500
+
+/* Control pins shown for raw bus events, left to right */
+static uint8_t (*nand_pins[NAND_PIN_COUNT])(uint8_t ctrl) = {
+	nand_ale,
+	nand_cle,
+	nand_we,
+	nand_re,
+	nand_rb,
+};
+
+static const char *column_names[EVENT_COLUMN_COUNT] = {
+	"Index",
+	"Start",
+	"Duration (ns)",
+	"Type",
+	"CE",
+	"Row",
+	"Column",
+	"Size",
+	"Entropy",
+};
 
 EventItemModel::EventItemModel(QObject *parent) :
-	QAbstractItemModel(parent)
+	QAbstractItemModel(parent),
+	_sortColumn(EVENT_COLUMN_INDEX),
+	_sortOrder(Qt::AscendingOrder)
 {
+	QList<QString> &types = EventTypes();
+	for (int type = 0; type < EVENT_TYPE_COUNT; type++) {
+		// Strip the EVT_ prefix
+		_typeLabels[type] = types.at(type < types.count() ? type : 0);
+		_typeLabels[type].remove(0, 4);
+	}
+
+	connect(&_events, SIGNAL(eventsLoaded()), this, SLOT(gotEventsLoaded()));
+	connect(&_events, SIGNAL(loadFinished()), this, SIGNAL(loadFinished()));
 }
 
 int EventItemModel::loadFile(QString &filename)
 {
-	QFile input;
-	input.setFileName(filename);
-	if (!input.open(QIODevice::ReadOnly)) {
-		qDebug() << "Couldn't open event stream file: " << input.errorString();
-		return -1;
+	_entropyBar.clear();
+	_sizeBar.clear();
+	_pins.clear();
+	_rowOrder.clear();
+	_rowPosition.clear();
+	return _events.load(filename);
+}
+
+/* Queued from the loader thread; may cover several batches at once */
+void EventItemModel::gotEventsLoaded()
+{
+	QVector<int> events = _events.takeLoadedEvents();
+	updateDisplayData();
+	if (!events.isEmpty()) {
+		int first = _events.count();
+		beginInsertRows(QModelIndex(), first, first + events.count() - 1);
+		_events.appendEvents(events);
+		if (isSorted()) {
+			// Show them at the end until they're merged in below
+			for (int row = first; row < _events.count(); row++) {
+				_rowOrder.append(row);
+				_rowPosition.append(row);
+			}
+		}
+		endInsertRows();
+
+		if (isSorted()) {
+			QVector<int> order = _rowOrder;
+			order.resize(first);
+			event_sort_append(_events.table(), _events.currentEvents(),
+							  _sortColumn, _sortOrder == Qt::DescendingOrder, order);
+			relayout(_events.currentEvents(), order);
+		}
 	}
-	return _events.load(input);
+	emit eventsAvailable();
 }
 
 QModelIndex EventItemModel::index(int row, int column, const QModelIndex &parent) const
@@ -50,80 +117,162 @@ int EventItemModel::rowCount(const QModelIndex &parent) const
 int EventItemModel::columnCount(const QModelIndex &parent) const
 {
 	Q_UNUSED(parent);
-	return 1;
-}
-
-QVariant EventItemModel::drawEntropyBackground(const Event &e) const
-{
-	QImage imageBar(500, 16, QImage::Format_RGB32);
-	QPainter painter(&imageBar);
-	painter.fillRect(0, 0, 2500, 16, QColor::fromRgb(255, 255, 255, 255));
-	painter.fillRect(0, 0, (int)(10+(e.entropy()*200)), 8, QColor::fromRgb(255, 128, 128));
-	painter.fillRect(0, 8, (int)(10+(e.data().size()/100.0)), 8, QColor::fromHsvF(.13, .34, .93));
-
-	QBrush brush(imageBar);
-	return brush;
-}
-
-QVariant EventItemModel::drawNandUnknownBackground(const Event &e) const
-{
-	QImage imageBar(500, 16, QImage::Format_RGB32);
-	qreal onS = .95;
-	qreal offS = .13;
-	qreal onV = .83;
-	qreal offV = .98;
-	uint8_t (*nand_ctrl[])(uint8_t ctrl) = {
-		nand_ale,
-		nand_cle,
-		nand_we,
-		nand_re,
-		nand_rb,
-	};
-	qreal colors[] = {
-		.1,
-		.4,
-		.8,
-		.6,
-		.33,
-	};
-
-	int top = 4;
-	int left = 120;
-	int height = 8;
-	int width = 14;
-
-	QPainter painter(&imageBar);
-	painter.fillRect(0, 0, 2500, 16, QColor::fromRgb(255, 255, 255, 255));
-
-	painter.setPen(QColor::fromRgb(192,192,192));
-
-	for (int i=0; i<5; i++) {
-		painter.drawRect(left, top-1, width+1, height+1);
-		left++;
-		if (nand_ctrl[i](e.nandUnknownControl()))
-			painter.fillRect(left, top, width, height, QColor::fromHsvF(colors[i], onS, onV));
-		else
-			painter.fillRect(left, top, width, height, QColor::fromHsvF(colors[i], offS, offV));
-		left += 20;
+	return EVENT_COLUMN_COUNT;
+}
+
+QVariant EventItemModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+	if (orientation != Qt::Horizontal || role != Qt::DisplayRole
+	 || section < 0 || section >= EVENT_COLUMN_COUNT)
+		return QVariant();
+	return QVariant(column_names[section]);
+}
+
+bool EventItemModel::isSorted() const
+{
+	return _sortColumn != EVENT_COLUMN_INDEX || _sortOrder != Qt::AscendingOrder;
+}
+
+int EventItemModel::streamRow(int row) const
+{
+	return _rowOrder.isEmpty() ? row : _rowOrder.at(row);
+}
+
+int EventItemModel::viewRow(int streamRow) const
+{
+	return _rowPosition.isEmpty() ? streamRow : _rowPosition.at(streamRow);
+}
+
+/* Sorting only reorders rows.  Keys come straight from the event table
+ * and are sorted in parallel into a permutation of the stream's rows.
+ */
+void EventItemModel::sort(int column, Qt::SortOrder order)
+{
+	QVector<int> rows;
+
+	if (column < 0 || column >= EVENT_COLUMN_COUNT)
+		return;
+	_sortColumn = column;
+	_sortOrder = order;
+
+	if (isSorted())
+		event_sort(_events.table(), _events.currentEvents(),
+				   _sortColumn, _sortOrder == Qt::DescendingOrder, rows);
+	relayout(_events.currentEvents(), rows);
+}
+
+/* Switch to a new row list and order in one layout change, keeping
+ * persistent indexes on the same events.  An empty order means file
+ * order.
+ */
+void EventItemModel::relayout(const QVector<int> &events, const QVector<int> &order)
+{
+	emit layoutAboutToBeChanged();
+
+	QModelIndexList oldIndexes = persistentIndexList();
+	QModelIndexList newIndexes;
+	QVector<int> oldEvents;
+	int k;
+
+	for (k = 0; k < oldIndexes.count(); k++)
+		oldEvents.append(_events.currentEvents().at(streamRow(oldIndexes.at(k).row())));
+
+	_events.setCurrentEvents(events);
+	_rowOrder = order;
+	_rowPosition.resize(order.count());
+	for (k = 0; k < order.count(); k++)
+		_rowPosition[order.at(k)] = k;
+
+	for (k = 0; k < oldIndexes.count(); k++) {
+		QVector<int>::const_iterator it = qBinaryFind(events.constBegin(),
+				events.constEnd(), oldEvents.at(k));
+		if (it == events.constEnd())
+			newIndexes.append(QModelIndex());
+		else {
+			int row = viewRow(it - events.constBegin());
+			newIndexes.append(createIndex(row, oldIndexes.at(k).column(), row));
+		}
 	}
 
-	QBrush brush(imageBar);
-	return brush;
+	changePersistentIndexList(oldIndexes, newIndexes);
+	emit layoutChanged();
+}
+
+void EventItemModel::prefetch(int row, int count) const
+{
+	if (!isSorted()) {
+		_events.prefetch(row, count);
+		return;
+	}
+
+	int last = qMin(row + count, rowCount());
+	for (row = qMax(row, 0); row < last; row++)
+		_events.prefetch(streamRow(row), 1);
+}
+
+/* Work out bar widths and pin states for events loaded since last time */
+void EventItemModel::updateDisplayData()
+{
+	const struct EventTable &table = _events.table();
+	int first = _entropyBar.count();
+	int last = _events.loadedCount();
+
+	_entropyBar.resize(last);
+	_sizeBar.resize(last);
+	_pins.resize(last);
+	for (int i = first; i < last; i++) {
+		quint8 pins = 0;
+		for (int pin = 0; pin < NAND_PIN_COUNT; pin++)
+			if (nand_pins[pin](table.ctrl.at(i)))
+				pins |= 1 << pin;
+		_pins[i] = pins;
+		_entropyBar[i] = qMin(BAR_WIDTH_MAX, (int)(10 + table.entropy.at(i) * 25));
+		_sizeBar[i] = qMin((quint32)BAR_WIDTH_MAX, 10 + table.size.at(i) / 100);
+	}
 }
 
 QVariant EventItemModel::data(const QModelIndex &index, int role) const
 {
-	const Event e = _events.eventAt(index.row());
+	const struct EventTable &table = _events.table();
+	int event = _events.currentEvents().at(streamRow(index.row()));
+	quint8 type = table.type.at(event);
 
 	if (role == Qt::SizeHintRole) {
-		return QVariant(QSize(200,16));
+		return QVariant(QSize(index.column() == EVENT_COLUMN_TYPE ? 200 : 80, 16));
 	}
 
 	else if (role == Qt::DisplayRole) {
-		QString temp;
-		temp = e.eventTypeStr();
-		temp.remove(0, 4);
-		return QVariant(temp);
+		switch (index.column()) {
+		case EVENT_COLUMN_INDEX:
+			return QVariant(event);
+		case EVENT_COLUMN_START:
+			return QVariant(QString("%1.%2")
+					.arg(table.start.at(event) / 1000000000)
+					.arg(table.start.at(event) % 1000000000, 9, 10, QLatin1Char('0')));
+		case EVENT_COLUMN_DURATION:
+			return QVariant(table.end.at(event) - table.start.at(event));
+		case EVENT_COLUMN_TYPE:
+			return QVariant(_typeLabels[type]);
+		case EVENT_COLUMN_CE:
+			if (table.ce.at(event) < 0)
+				return QVariant();
+			return QVariant(table.ce.at(event));
+		case EVENT_COLUMN_ROW:
+			if (table.row.at(event) < 0)
+				return QVariant();
+			return QVariant(table.row.at(event));
+		case EVENT_COLUMN_COLUMN:
+			if (table.column.at(event) < 0)
+				return QVariant();
+			return QVariant(table.column.at(event));
+		case EVENT_COLUMN_SIZE:
+			return QVariant(table.size.at(event));
+		case EVENT_COLUMN_ENTROPY:
+			if (!table.size.at(event))
+				return QVariant();
+			return QVariant(QString::number(table.entropy.at(event), 'f', 2));
+		}
+		return QVariant();
 	}
 
 	else if (role == Qt::DecorationRole) {
@@ -137,17 +286,29 @@ QVariant EventItemModel::data(const QModelIndex &index, int role) const
 	else if (role == Qt::FontRole)
 		return QVariant();
 
-	else if (role == Qt::TextAlignmentRole)
+	else if (role == Qt::TextAlignmentRole) {
+		if (index.column() == EVENT_COLUMN_TYPE)
+			return QVariant();
+		return QVariant(Qt::AlignRight | Qt::AlignVCenter);
+	}
+
+	else if (role == Qt::BackgroundColorRole)
 		return QVariant();
 
-	else if (role == Qt::BackgroundColorRole) {
-		if (e.eventType() == EVT_NAND_UNKNOWN)
-			return drawNandUnknownBackground(e);
-		if (e.entropy() < 1.0)
-			return drawEntropyBackground(e);
+	else if (role == PinsRole) {
+		if (type == EVT_NAND_UNKNOWN)
+			return QVariant(_pins.at(event));
 		return QVariant();
 	}
 
+	else if (role == EntropyBarRole || role == SizeBarRole) {
+		if (!table.size.at(event))
+			return QVariant();
+		if (role == EntropyBarRole)
+			return QVariant(_entropyBar.at(event));
+		return QVariant(_sizeBar.at(event));
+	}
+
 	else if (role == Qt::TextColorRole)
 		return QVariant();
 
@@ -161,17 +322,132 @@ QVariant EventItemModel::data(const QModelIndex &index, int role) const
 	return QVariant();
 }
 
-const Event &EventItemModel::eventAt(int index)
+Event EventItemModel::eventAt(int index) const
 {
-	return _events.eventAt(index);
+	return _events.eventAt(streamRow(index));
+}
+
+/* The stream index of the event shown on a row, without decoding it */
+int EventItemModel::eventIndex(int row) const
+{
+	return _events.currentEvents().at(streamRow(row));
+}
+
+/* The list row showing event index, or -1 if it's filtered out */
+int EventItemModel::rowForEvent(int index) const
+{
+	const QVector<int> &current = _events.currentEvents();
+	QVector<int>::const_iterator it = qBinaryFind(current.constBegin(), current.constEnd(), index);
+	if (it == current.constEnd())
+		return -1;
+	return viewRow(it - current.constBegin());
+}
+
+QVector<int> EventItemModel::eventsForRow(quint32 nandRow) const
+{
+	return _events.eventsForRow(nandRow);
+}
+
+const struct EventTable &EventItemModel::table() const
+{
+	return _events.table();
+}
+
+const EventStream &EventItemModel::events() const
+{
+	return _events;
 }
 
 void EventItemModel::ignoreEventsOfType(int type)
 {
-    _events.ignoreEventsOfType(type);
+    _events.setTypeHidden(type, true);
+    updateRows();
+    emit rowsFiltered();
 }
 
 void EventItemModel::resetIgnoredEvents()
 {
-    _events.resetIgnoredEvents();
+    _events.showAllTypes();
+    updateRows();
+    emit rowsFiltered();
+}
+
+int EventItemModel::setFilter(const QString &text)
+{
+    if (_events.setFilter(text))
+        return -1;
+    updateRows();
+    emit rowsFiltered();
+    return 0;
+}
+
+void EventItemModel::setCacheBudget(int megabytes)
+{
+    _events.setCacheBudget(megabytes);
+}
+
+const QString &EventItemModel::filterError() const
+{
+    return _events.filterError();
+}
+
+/* Extend the last (row, count) run, or start a new one */
+static void add_run(QVector<QPair<int, int> > &runs, int row)
+{
+	if (!runs.isEmpty() && runs.last().first + runs.last().second == row)
+		runs.last().second++;
+	else
+		runs.append(qMakePair(row, 1));
+}
+
+/* Bring the rows in line with the events the stream says are visible.
+ * Both lists are in ascending event order, so one merge pass finds the
+ * rows that go away and the rows that appear.  A sorted view is sorted
+ * again and relaid out in one go.
+ */
+void EventItemModel::updateRows()
+{
+	QVector<int> current = _events.currentEvents();
+	QVector<int> visible = _events.visibleEvents();
+	QVector<QPair<int, int> > removed, inserted;
+	int i = 0, j = 0, k;
+
+	if (isSorted()) {
+		QVector<int> order;
+		event_sort(_events.table(), visible, _sortColumn,
+				   _sortOrder == Qt::DescendingOrder, order);
+		relayout(visible, order);
+		return;
+	}
+
+	while (i < current.count() || j < visible.count()) {
+		if (j >= visible.count()
+		 || (i < current.count() && current.at(i) < visible.at(j)))
+			add_run(removed, i++);
+		else if (i >= current.count() || visible.at(j) < current.at(i))
+			add_run(inserted, j++);
+		else
+			i++, j++;
+	}
+
+	if (removed.count() + inserted.count() > FILTER_MAX_RUNS) {
+		relayout(visible, QVector<int>());
+		return;
+	}
+
+	// Remove from the back so earlier rows keep their numbers
+	for (k = removed.count() - 1; k >= 0; k--) {
+		int row = removed.at(k).first, count = removed.at(k).second;
+		beginRemoveRows(QModelIndex(), row, row + count - 1);
+		_events.removeEvents(row, count);
+		endRemoveRows();
+	}
+
+	// Insert from the front, at their final row numbers
+	for (k = 0; k < inserted.count(); k++) {
+		int row = inserted.at(k).first, count = inserted.at(k).second;
+		beginInsertRows(QModelIndex(), row, row + count - 1);
+		_events.insertEvents(row, visible.constData() + row, count);
+		endInsertRows();
+	}
 }
@@ -4,10 +4,20 @@
 #include <QAbstractItemModel>
 #include "eventstream.h"
 
+/* Raw bus events show this many control pins: ALE, CLE, WE, RE, RB */
+#define NAND_PIN_COUNT 5
+
 class EventItemModel : public QAbstractItemModel
 {
 	Q_OBJECT
 public:
+	/* Values EventItemDelegate draws from */
+	enum {
+		EntropyBarRole = Qt::UserRole,
+		SizeBarRole,
+		PinsRole,
+	};
+
 	explicit EventItemModel(QObject *parent = 0);
 	int loadFile(QString &filename);
 	int rowCount(const QModelIndex &parent = QModelIndex()) const ;
@@ -15,22 +25,59 @@ public:
 	QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
 	QModelIndex index(int row, int column, const QModelIndex &parent) const;
 	QModelIndex parent(const QModelIndex &child) const;
+	QVariant headerData(int section, Qt::Orientation orientation,
+						int role = Qt::DisplayRole) const;
+	void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
 
-	const Event &eventAt(int index);
+	Event eventAt(int index) const;
+	int eventIndex(int row) const;
+	int rowForEvent(int index) const;
+	QVector<int> eventsForRow(quint32 nandRow) const;
+	const struct EventTable &table() const;
+	const EventStream &events() const;
+	void prefetch(int row, int count) const;
 
     void ignoreEventsOfType(int type);
     void resetIgnoredEvents();
+    int setFilter(const QString &text);
+    const QString &filterError() const;
+    void setCacheBudget(int megabytes);
 
 private:
 	EventStream _events;
-    EventStream _currentEvents;
-	QVariant drawEntropyBackground(const Event &e) const;
-	QVariant drawNandUnknownBackground(const Event &e) const;
+
+	/* What data() shows, worked out once per type or per event as
+	 * events load.  The per-event arrays are indexed by event, not row.
+	 */
+	QString _typeLabels[EVENT_TYPE_COUNT];
+	QVector<quint16> _entropyBar;
+	QVector<quint16> _sizeBar;
+	QVector<quint8> _pins;      // One bit per entry in nand_pins[]
+
+	/* Sorted view.  View row r shows the stream's row _rowOrder[r], and
+	 * _rowPosition maps back.  Both are empty in file order.
+	 */
+	int _sortColumn;
+	Qt::SortOrder _sortOrder;
+	QVector<int> _rowOrder;
+	QVector<int> _rowPosition;
+
+	bool isSorted() const;
+	int streamRow(int row) const;
+	int viewRow(int streamRow) const;
+	void relayout(const QVector<int> &events, const QVector<int> &order);
+
+	void updateDisplayData();
+	void updateRows();
 
 signals:
-	
+	void eventsAvailable();
+	void loadFinished();
+	void rowsFiltered();
+
 public slots:
-	
+	void gotEventsLoaded();
+
 };
 
 #endif // EVENTITEMMODEL_H
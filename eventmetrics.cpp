@@ -0,0 +1,186 @@
+#include <QtConcurrentMap>
+#include <QDebug>
+#include <stddef.h>
+#include "eventmetrics.h"
+#include "entropy.h"
+#include "byteswap.h"
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+/* Events are grouped into ranges of this many for the parallel pass */
+#define METRICS_RANGE_SIZE 4096
+
+/* Whether a packet of evtSize bytes reaches the end of field */
+#define PACKET_COVERS(evtSize, member, field) \
+	(offsetof(union evt, member.field) + sizeof(((union evt *)0)->member.field) <= (evtSize))
+
+uint32_t event_payload(const union evt *evt, uint32_t evtSize, const uint8_t **data)
+{
+	uint32_t count;
+
+	*data = NULL;
+	if (!PACKET_COVERS(evtSize, header, type))
+		return 0;
+
+	switch (evt->header.type) {
+	case EVT_NAND_CHANGE_READ_COLUMN:
+		if (!PACKET_COVERS(evtSize, nand_change_read_coumn, count))
+			return 0;
+		count = _ntohl(evt->nand_change_read_coumn.count);
+		*data = evt->nand_change_read_coumn.data;
+		break;
+
+	case EVT_NAND_READ:
+		if (!PACKET_COVERS(evtSize, nand_read, count))
+			return 0;
+		count = _ntohl(evt->nand_read.count);
+		*data = evt->nand_read.data;
+		break;
+
+	case EVT_NAND_DATA:
+		if (!PACKET_COVERS(evtSize, nand_data, count))
+			return 0;
+		count = _ntohl(evt->nand_data.count);
+		*data = evt->nand_data.data;
+		break;
+
+	case EVT_NAND_PARAMETER_READ:
+		if (!PACKET_COVERS(evtSize, nand_parameter_read, count))
+			return 0;
+		count = _ntohs(evt->nand_parameter_read.count);
+		*data = evt->nand_parameter_read.data;
+		break;
+
+	case EVT_SD_CMD:
+		if (!PACKET_COVERS(evtSize, sd_cmd, num_results))
+			return 0;
+		count = _ntohl(evt->sd_cmd.num_results);
+		*data = evt->sd_cmd.result;
+		break;
+
+	default:
+		return 0;
+	}
+
+	// Never run past the end of the packet
+	uint32_t offset = *data - (const uint8_t *)evt;
+	if (offset >= evtSize)
+		return 0;
+	return qMin(count, evtSize - offset);
+}
+
+qreal event_entropy(const uint8_t *data, uint32_t size)
+{
+	return shannon_entropy(data, size);
+}
+
+uint32_t event_hash(const uint8_t *data, uint32_t size)
+{
+	uint32_t hash = FNV_OFFSET_BASIS;
+	while (size--) {
+		hash ^= *data++;
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+static bool is_erased(const uint8_t *data, uint32_t size)
+{
+	if (!size)
+		return false;
+	while (size--)
+		if (*data++ != 0xff)
+			return false;
+	return true;
+}
+
+void event_compute_metrics(const union evt *evt, uint32_t evtSize,
+						   struct evt_metadata *meta)
+{
+	const uint8_t *data;
+	uint32_t size;
+
+	memset(meta, 0, sizeof(*meta));
+
+	if ((evt->header.type == EVT_NAND_READ
+	  || evt->header.type == EVT_NAND_CHANGE_READ_COLUMN
+	  || evt->header.type == EVT_NAND_DATA)
+	 && evtSize >= sizeof(evt->header) + sizeof(evt->nand_read.addr)) {
+		const uint8_t *addr = evt->nand_read.addr;
+		meta->column = (addr[1] << 8) | addr[0];
+		meta->row = (addr[4] << 16) | (addr[3] << 8) | addr[2];
+		meta->flags |= EVT_META_HAS_ADDRESS;
+	}
+
+	size = event_payload(evt, evtSize, &data);
+	if (size) {
+		meta->flags |= EVT_META_HAS_DATA;
+		meta->entropy = (uint32_t)(event_entropy(data, size) * 65536.0);
+		meta->hash = event_hash(data, size);
+		if (is_erased(data, size))
+			meta->flags |= EVT_META_ERASED;
+	}
+}
+
+void event_metadata_swap(struct evt_metadata *meta)
+{
+	meta->entropy = _htonl(meta->entropy);
+	meta->hash = _htonl(meta->hash);
+	meta->row = _htonl(meta->row);
+	meta->column = _htons(meta->column);
+}
+
+struct metrics_range {
+	const uchar *base;
+	qint64 baseSize;
+	const uint32_t *offsets;
+	struct evt_metadata *metadata;
+	int first;
+	int last;
+};
+
+static void compute_range(struct metrics_range &range)
+{
+	for (int i = range.first; i < range.last; i++) {
+		const union evt *evt = (const union evt *)(range.base + range.offsets[i]);
+		struct evt_metadata *meta = &range.metadata[i];
+
+		if (range.offsets[i] + sizeof(evt->header) > (quint64)range.baseSize
+		 || range.offsets[i] + _ntohl(evt->header.size) > (quint64)range.baseSize) {
+			memset(meta, 0, sizeof(*meta));
+			continue;
+		}
+		event_compute_metrics(evt, _ntohl(evt->header.size), meta);
+	}
+}
+
+int event_compute_metrics_range(const uchar *base, qint64 baseSize,
+								const uint32_t *offsets, int first, int last,
+								struct evt_metadata *metadata)
+{
+	QVector<struct metrics_range> ranges;
+
+	for (; first < last; first += METRICS_RANGE_SIZE) {
+		struct metrics_range range;
+		range.base = base;
+		range.baseSize = baseSize;
+		range.offsets = offsets;
+		range.metadata = metadata;
+		range.first = first;
+		range.last = qMin(first + METRICS_RANGE_SIZE, last);
+		ranges.append(range);
+	}
+
+	QtConcurrent::blockingMap(ranges, compute_range);
+	return 0;
+}
+
+int event_compute_metrics_all(const uchar *base, qint64 baseSize,
+							  const QVector<uint32_t> &offsets,
+							  QVector<struct evt_metadata> &metadata)
+{
+	metadata.resize(offsets.count());
+	return event_compute_metrics_range(base, baseSize, offsets.constData(),
+									   0, offsets.count(), metadata.data());
+}
@@ -0,0 +1,36 @@
+#ifndef EVENTMETRICS_H
+#define EVENTMETRICS_H
+
+#include <QVector>
+#include <stdint.h>
+#include "event-struct.h"
+
+/* Locate the payload of an event that is evtSize bytes long.
+ * Returns the payload size, or 0 if it has none.
+ */
+uint32_t event_payload(const union evt *evt, uint32_t evtSize, const uint8_t **data);
+
+/* Shannon entropy of a payload, in bits per byte (0 - 8) */
+qreal event_entropy(const uint8_t *data, uint32_t size);
+uint32_t event_hash(const uint8_t *data, uint32_t size);
+
+/* Compute derived values for one event (in file byte order) */
+void event_compute_metrics(const union evt *evt, uint32_t evtSize,
+						   struct evt_metadata *meta);
+
+/* Compute derived values for every event in a mapped event file, in parallel */
+int event_compute_metrics_all(const uchar *base, qint64 baseSize,
+							  const QVector<uint32_t> &offsets,
+							  QVector<struct evt_metadata> &metadata);
+
+/* Same, for events first to last-1 only.  metadata must hold a record for
+ * every event in offsets.
+ */
+int event_compute_metrics_range(const uchar *base, qint64 baseSize,
+								const uint32_t *offsets, int first, int last,
+								struct evt_metadata *metadata);
+
+/* Convert a metadata record between host and file byte order */
+void event_metadata_swap(struct evt_metadata *meta);
+
+#endif // EVENTMETRICS_H
@@ -0,0 +1,188 @@
+#include <QtConcurrentMap>
+#include <QThread>
+#include <algorithm>
+#include "eventsort.h"
+
+/* Don't split sorts into chunks smaller than this */
+#define SORT_CHUNK_MIN 65536
+
+#define SIGN_BIT Q_UINT64_C(0x8000000000000000)
+
+/* Every column is turned into an unsigned key that sorts the same way,
+ * so one comparison serves them all.  pos breaks ties.
+ */
+struct sort_entry {
+	quint64 key;
+	int pos;
+
+	bool operator<(const struct sort_entry &other) const {
+		return key < other.key || (key == other.key && pos < other.pos);
+	}
+};
+
+struct sort_range {
+	struct sort_entry *entries;
+	struct sort_entry *out;
+	int first;
+	int middle;
+	int last;
+};
+
+static inline quint64 signed_key(qint64 value)
+{
+	return (quint64)value ^ SIGN_BIT;
+}
+
+static inline quint64 float_key(float value)
+{
+	union {
+		float f;
+		quint32 u;
+	} bits;
+	bits.f = value;
+	return (bits.u & 0x80000000) ? ~bits.u & 0xffffffff : bits.u | 0x80000000;
+}
+
+/* Keys for events[positions[i]], or events[first + i] if positions is NULL */
+static void fill_keys(const struct EventTable &table, const QVector<int> &events,
+					  const int *positions, int first, int count, int column,
+					  bool descending, struct sort_entry *out)
+{
+	const int *e = events.constData();
+	int i;
+
+#define FILL(expr) \
+	for (i = 0; i < count; i++) { \
+		int pos = positions ? positions[i] : first + i; \
+		int event = e[pos]; \
+		out[i].key = (expr); \
+		out[i].pos = pos; \
+	}
+
+	switch (column) {
+	case EVENT_COLUMN_START:
+		FILL(signed_key(table.start.at(event)));
+		break;
+	case EVENT_COLUMN_DURATION:
+		FILL(signed_key(table.end.at(event) - table.start.at(event)));
+		break;
+	case EVENT_COLUMN_TYPE:
+		FILL(table.type.at(event));
+		break;
+	case EVENT_COLUMN_CE:
+		FILL(signed_key(table.ce.at(event)));
+		break;
+	case EVENT_COLUMN_ROW:
+		FILL(signed_key(table.row.at(event)));
+		break;
+	case EVENT_COLUMN_COLUMN:
+		FILL(signed_key(table.column.at(event)));
+		break;
+	case EVENT_COLUMN_SIZE:
+		FILL(table.size.at(event));
+		break;
+	case EVENT_COLUMN_ENTROPY:
+		FILL(float_key(table.entropy.at(event)));
+		break;
+	case EVENT_COLUMN_INDEX:
+	default:
+		FILL((quint64)event);
+		break;
+	}
+#undef FILL
+
+	if (descending)
+		for (i = 0; i < count; i++)
+			out[i].key = ~out[i].key;
+}
+
+static void sort_chunk(struct sort_range &range)
+{
+	std::sort(range.entries + range.first, range.entries + range.last);
+}
+
+static void merge_chunks(struct sort_range &range)
+{
+	std::merge(range.entries + range.first, range.entries + range.middle,
+			   range.entries + range.middle, range.entries + range.last,
+			   range.out + range.first);
+}
+
+/* Sort chunks on every core, then merge pairs of them a round at a time */
+static void parallel_sort(QVector<struct sort_entry> &entries)
+{
+	QVector<struct sort_entry> buffer;
+	QVector<struct sort_range> ranges;
+	int n = entries.count();
+	int chunks = qMax(1, qMin(QThread::idealThreadCount(), n / SORT_CHUNK_MIN));
+	int width = (n + chunks - 1) / chunks;
+	int first;
+
+	for (first = 0; first < n; first += width) {
+		struct sort_range range;
+		range.entries = entries.data();
+		range.out = NULL;
+		range.first = first;
+		range.middle = first;
+		range.last = qMin(first + width, n);
+		ranges.append(range);
+	}
+	QtConcurrent::blockingMap(ranges, sort_chunk);
+
+	if (width >= n)
+		return;
+
+	buffer.resize(n);
+	for (; width < n; width *= 2) {
+		ranges.clear();
+		for (first = 0; first < n; first += 2 * width) {
+			struct sort_range range;
+			range.entries = entries.data();
+			range.out = buffer.data();
+			range.first = first;
+			range.middle = qMin(first + width, n);
+			range.last = qMin(first + 2 * width, n);
+			ranges.append(range);
+		}
+		QtConcurrent::blockingMap(ranges, merge_chunks);
+		entries.swap(buffer);
+	}
+}
+
+int event_sort(const struct EventTable &table, const QVector<int> &events,
+			   int column, bool descending, QVector<int> &order)
+{
+	QVector<struct sort_entry> entries(events.count());
+	int i;
+
+	fill_keys(table, events, NULL, 0, events.count(), column, descending, entries.data());
+	parallel_sort(entries);
+
+	order.resize(entries.count());
+	for (i = 0; i < entries.count(); i++)
+		order[i] = entries.at(i).pos;
+	return 0;
+}
+
+int event_sort_append(const struct EventTable &table, const QVector<int> &events,
+					  int column, bool descending, QVector<int> &order)
+{
+	int old = order.count();
+	int added = events.count() - old;
+	QVector<struct sort_entry> sorted(old), appended(added), merged(events.count());
+	int i;
+
+	if (added <= 0)
+		return 0;
+
+	fill_keys(table, events, order.constData(), 0, old, column, descending, sorted.data());
+	fill_keys(table, events, NULL, old, added, column, descending, appended.data());
+	parallel_sort(appended);
+	std::merge(sorted.constBegin(), sorted.constEnd(),
+			   appended.constBegin(), appended.constEnd(), merged.begin());
+
+	order.resize(merged.count());
+	for (i = 0; i < merged.count(); i++)
+		order[i] = merged.at(i).pos;
+	return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef EVENTSORT_H
+#define EVENTSORT_H
+
+#include <QVector>
+#include "eventtable.h"
+
+/* Columns of the event list, each of which it can be sorted on */
+enum event_column {
+	EVENT_COLUMN_INDEX,
+	EVENT_COLUMN_START,
+	EVENT_COLUMN_DURATION,
+	EVENT_COLUMN_TYPE,
+	EVENT_COLUMN_CE,
+	EVENT_COLUMN_ROW,
+	EVENT_COLUMN_COLUMN,
+	EVENT_COLUMN_SIZE,
+	EVENT_COLUMN_ENTROPY,
+	EVENT_COLUMN_COUNT,
+};
+
+/* Sort events by column, in parallel.  order gets positions in events,
+ * so events[order[0]] comes first.  Ties stay in events order.
+ */
+int event_sort(const struct EventTable &table, const QVector<int> &events,
+			   int column, bool descending, QVector<int> &order);
+
+/* events has grown since order was sorted.  Sort the new positions and
+ * merge them in.
+ */
+int event_sort_append(const struct EventTable &table, const QVector<int> &events,
+					  int column, bool descending, QVector<int> &order);
+
+#endif // EVENTSORT_H
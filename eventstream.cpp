@@ -1,6 +1,9 @@
 #include <QDebug>
+#include <QtConcurrentRun>
 #include "eventstream.h"
 #include "byteswap.h"
+#include "eventmetrics.h"
+#include "nand.h"
 
 static const char *EVENT_HDR_1 = "TBEv";
 static const char *EVENT_HDR_2 = "MaDa";
@@ -8,22 +11,86 @@ static const char *EVENT_HDR_2 = "MaDa";
 
 
 EventStream::EventStream(QObject *parent) :
-    QObject(parent)
+    QObject(parent),
+    _base(NULL),
+    _size(0),
+    _metadata(NULL),
+    _cache(EVENT_CACHE_DEFAULT_MB * 1024 * 1024),
+    _cacheHits(0),
+    _cacheMisses(0),
+    _lastRow(0),
+    _direction(1),
+    _complete(1),
+    _published(0),
+    _offsetAdjust(0)
 {
+    memset(_typeHidden, 0, sizeof(_typeHidden));
 }
 
-int EventStream::load(QIODevice &source)
+EventStream::~EventStream()
 {
-    uint8_t sig[4];
-    int32_t size;
-    int offset;
+    _abort.fetchAndStoreOrdered(1);
+    _loader.waitForFinished();
+}
+
+/* Map the event file and check its headers.  The offset table is read
+ * on a worker thread, which announces batches of events through
+ * eventsLoaded().  Events themselves are only decoded when eventAt()
+ * asks for them.
+ */
+int EventStream::load(const QString &fileName)
+{
+    const uchar *sig;
+    uint32_t size;
+    qint64 dataStart;
+    uint32_t first;
     struct evt_file_header file_header;
 
-    if (source.read((char *)&file_header, sizeof(file_header)) != sizeof(file_header)) {
-        qDebug() << "Unable to read file header: " << source.errorString();
+    _abort.fetchAndStoreOrdered(1);
+    _loader.waitForFinished();
+    _complete.fetchAndStoreRelease(1);
+    _cache.clear();
+    _cacheHits = 0;
+    _cacheMisses = 0;
+    _lastRow = 0;
+
+    // Closing unmaps the old file, so nothing may point into it even if
+    // the new one is rejected below
+    _file.close();
+    _base = NULL;
+    _size = 0;
+    _metadata = NULL;
+    _localMetadata.clear();
+    _offsets.clear();
+    _currentEvents.clear();
+    for (int type = 0; type < EVENT_TYPE_COUNT; type++)
+        _typeEvents[type].clear();
+    _visibleEvents.clear();
+    _filterMatches.clear();
+    _table.resize(0);
+    _rowIndexReady.fetchAndStoreRelease(0);
+    _published = 0;
+    _loaded.fetchAndStoreRelease(0);
+
+    _file.setFileName(fileName);
+    if (!_file.open(QIODevice::ReadOnly)) {
+        qDebug() << "Couldn't open event stream file: " << _file.errorString();
         return -1;
     }
 
+    _size = _file.size();
+    if (_size < (qint64)sizeof(file_header)) {
+        qDebug() << "Unable to read file header: file is too short";
+        return -1;
+    }
+
+    _base = _file.map(0, _size);
+    if (!_base) {
+        qDebug() << "Unable to map event stream file: " << _file.errorString();
+        return -1;
+    }
+
+    memcpy(&file_header, _base, sizeof(file_header));
     if (memcmp(&file_header.magic1, EVENT_HDR_1, sizeof(file_header.magic1))) {
         qDebug() << "Error: File signature doesn't match";
         qDebug("%x%x%x%x vs %x%x%x%x\n", 
@@ -35,42 +102,255 @@ int EventStream::load(QIODevice &source)
     }
 
     size = _ntohl(file_header.count);
-
-	for (offset=0; offset<size; offset++) {
-        uint32_t addr;
-        if (source.read((char *)&addr, sizeof(addr)) != sizeof(addr)) {
-            qDebug() << "Unable to read addr table: " << source.errorString();
-            return -1;
-        }
-        addr = _ntohl(addr);
-        _offsets.append(addr);
-    }
-    
-	if (source.read((char *)sig, sizeof(sig)) != sizeof(sig)) {
-        qDebug() << "Unable to read stream: " << source.errorString();
+    dataStart = sizeof(file_header) + (qint64)size * sizeof(uint32_t) + strlen(EVENT_HDR_2);
+    if (dataStart > _size) {
+        qDebug() << "Unable to read addr table: file is too short";
         return -1;
     }
 
-    if (memcmp(sig, EVENT_HDR_2, sizeof(sig))) {
+    sig = _base + dataStart - strlen(EVENT_HDR_2);
+    if (memcmp(sig, EVENT_HDR_2, strlen(EVENT_HDR_2))) {
         qDebug() << "Error: Main signature doesn't match";
         qDebug("%x%x%x%x vs %x%x%x%x\n", sig[0], sig[1], sig[2], sig[3],
                 EVENT_HDR_2[0], EVENT_HDR_2[1], EVENT_HDR_2[2], EVENT_HDR_2[3]);
         return -1;
     }
 
-    for (offset=0; offset<size; offset++) {
-        Event e(source, this);
-        _events.append(e);
+    // Older sorters didn't count the data signature in the offset table
+    _offsetAdjust = 0;
+    if (size) {
+        memcpy(&first, _base + sizeof(file_header), sizeof(first));
+        if (_ntohl(first) + strlen(EVENT_HDR_2) == dataStart)
+            _offsetAdjust = strlen(EVENT_HDR_2);
     }
 
-    _currentEvents = _events;
+    // Newer files carry a table of precomputed per-event values
+    if (_ntohl(file_header.version) >= EVENT_FILE_VERSION_METADATA
+     && file_header.metadata
+     && _ntohl(file_header.metadata) + (qint64)size * sizeof(struct evt_metadata) <= _size)
+        _metadata = (const struct evt_metadata *)(_base + _ntohl(file_header.metadata));
+
+    // Otherwise the loader derives it, straight from the mapping
+    else
+        _localMetadata.resize(size);
+
+    _offsets.resize(size);
+    _visibleEvents.fill(0, BITMAP_WORDS(size));
+    _filterMatches.fill(0, BITMAP_WORDS(size));
+    _table.resize(size);
+    _complete.fetchAndStoreRelease(0);
+    _abort.fetchAndStoreOrdered(0);
+    _loader = QtConcurrent::run(this, &EventStream::loadEvents);
 
     return 0;
 }
 
-const Event &EventStream::eventAt(int offset) const
+/* Runs on a worker thread.  Fills in offsets, metadata (if the file
+ * didn't have any) and the event table a batch at a time, publishing
+ * each through _loaded.
+ */
+void EventStream::loadEvents()
+{
+    const uint32_t *table = (const uint32_t *)(_base + sizeof(struct evt_file_header));
+    uint32_t *offsets = _offsets.data();
+    int count = _offsets.count();
+    int batch = LOAD_BATCH_FIRST;
+    int first, i;
+
+    for (first = 0; first < count; first += batch) {
+        int last = qMin(first + batch, count);
+
+        if (_abort)
+            return;
+
+        for (i = first; i < last; i++)
+            offsets[i] = _ntohl(table[i]) + _offsetAdjust;
+
+        // Spread across all cores
+        if (!_metadata)
+            event_compute_metrics_range(_base, _size, offsets, first, last,
+                                        _localMetadata.data());
+        event_table_fill(_table, _base, _size, offsets, _metadata,
+                         _localMetadata.constData(), first, last);
+
+        _loaded.fetchAndStoreRelease(last);
+        emit eventsLoaded();
+
+        batch = qMin(batch * 2, LOAD_BATCH_MAX);
+    }
+
+    row_index_build(_rowIndex, _table, count);
+    _rowIndexReady.fetchAndStoreRelease(1);
+
+    _complete.fetchAndStoreRelease(1);
+    emit loadFinished();
+}
+
+/* Not the loader future's state: loadFinished() is queued to the GUI
+ * thread and can arrive before the future is marked finished.
+ */
+bool EventStream::isLoading() const
+{
+    return !_complete.fetchAndAddAcquire(0);
+}
+
+int EventStream::loadedCount() const
+{
+    return _published;
+}
+
+int EventStream::totalCount() const
 {
-    return _currentEvents.at(offset);
+    return _offsets.count();
+}
+
+/* Hand out events the loader has finished since the last call, minus
+ * any of an ignored type or that fail the filter.  Pass them back to
+ * appendEvents() to show them.
+ */
+QVector<int> EventStream::takeLoadedEvents()
+{
+    QVector<int> events;
+    int loaded = _loaded.fetchAndAddAcquire(0);
+
+    _filter.evaluate(_table, _published, loaded, _filterMatches);
+
+    for (; _published < loaded; _published++) {
+        int type = _table.type.at(_published);
+
+        if (_typeEvents[type].isEmpty())
+            _typeEvents[type].fill(0, _visibleEvents.count());
+        bitmap_set(_typeEvents[type], _published);
+
+        if (!_typeHidden[type]) {
+            bitmap_set(_visibleEvents, _published);
+            if (bitmap_test(_filterMatches, _published))
+                events.append(_published);
+        }
+    }
+    return events;
+}
+
+void EventStream::appendEvents(const QVector<int> &events)
+{
+    _currentEvents += events;
+}
+
+uint32_t EventStream::eventPayload(int index, const uint8_t **data) const
+{
+    uint32_t size;
+    const union evt *evt = eventPacket(index, &size);
+
+    *data = NULL;
+    if (!evt)
+        return 0;
+    return event_payload(evt, size, data);
+}
+
+const union evt *EventStream::eventPacket(int index, uint32_t *size) const
+{
+    uint32_t offset = _offsets.at(index);
+    const union evt *evt = (const union evt *)(_base + offset);
+
+    *size = 0;
+    if ((qint64)offset + (qint64)sizeof(struct evt_header) > _size)
+        return NULL;
+    *size = qMin((qint64)_ntohl(evt->header.size), _size - offset);
+    return evt;
+}
+
+Event *EventStream::decodeEvent(int index) const
+{
+    uint32_t offset = _offsets.at(index);
+    Event *e;
+
+    if ((qint64)offset + (qint64)sizeof(struct evt_header) > _size) {
+        QByteArray empty;
+        qDebug() << "Event" << index << "lies outside the file";
+        e = new Event(empty);
+    }
+    else {
+        const struct evt_header *header = (const struct evt_header *)(_base + offset);
+        uint32_t size = qMin((qint64)_ntohl(header->size), _size - offset);
+        QByteArray raw = QByteArray::fromRawData((const char *)header, size);
+        e = new Event(raw);
+    }
+
+    e->setIndex(index);
+    if (_metadata) {
+        struct evt_metadata metadata = _metadata[index];
+        event_metadata_swap(&metadata);
+        e->setMetadata(metadata);
+    }
+    else if (index < _localMetadata.count())
+        e->setMetadata(_localMetadata.at(index));
+    return e;
+}
+
+/* Decode an event into the cache.  The copy is returned, as inserting
+ * can evict, or for an oversized event immediately delete, the object.
+ */
+Event EventStream::cacheEvent(int index) const
+{
+    Event *e = decodeEvent(index);
+    Event copy = *e;
+    _cache.insert(index, e, EVENT_CACHE_OVERHEAD + copy.eventSize());
+    return copy;
+}
+
+Event EventStream::eventAt(int offset) const
+{
+    int index = _currentEvents.at(offset);
+    Event *e = _cache.object(index);
+
+    if (offset != _lastRow)
+        _direction = offset > _lastRow ? 1 : -1;
+    _lastRow = offset;
+
+    if (e) {
+        _cacheHits++;
+        return *e;
+    }
+
+    _cacheMisses++;
+    Event event = cacheEvent(index);
+    if (_direction > 0)
+        prefetch(offset + 1, EVENT_READ_AHEAD);
+    else
+        prefetch(offset - EVENT_READ_AHEAD, EVENT_READ_AHEAD);
+    return event;
+}
+
+void EventStream::prefetch(int row, int count) const
+{
+    int last = qMin(row + count, _currentEvents.count());
+
+    for (row = qMax(row, 0); row < last; row++) {
+        int index = _currentEvents.at(row);
+        if (!_cache.contains(index))
+            cacheEvent(index);
+    }
+}
+
+void EventStream::setCacheBudget(int megabytes)
+{
+    megabytes = qBound(1, megabytes, EVENT_CACHE_MAX_MB);
+    _cache.setMaxCost(megabytes * 1024 * 1024);
+}
+
+int EventStream::cacheBudget() const
+{
+    return _cache.maxCost() / (1024 * 1024);
+}
+
+quint64 EventStream::cacheHits() const
+{
+    return _cacheHits;
+}
+
+quint64 EventStream::cacheMisses() const
+{
+    return _cacheMisses;
 }
 
 int EventStream::count() const
@@ -78,19 +358,114 @@ int EventStream::count() const
     return _currentEvents.count();
 }
 
-int EventStream::ignoreEventsOfType(int type)
+void EventStream::setTypeHidden(int type, bool hidden)
 {
-    QList<Event> tempList;
-    int i;
-    for (i=0; i<_currentEvents.count(); i++)
-        if (_currentEvents.at(i).eventType() != type)
-            tempList.append(_currentEvents.at(i));
-    _currentEvents = tempList;
-    return 0;
+    if (type < 0 || type >= EVENT_TYPE_COUNT || _typeHidden[type] == hidden)
+        return;
+
+    _typeHidden[type] = hidden;
+    if (hidden)
+        bitmap_andnot(_visibleEvents, _typeEvents[type]);
+    else
+        bitmap_or(_visibleEvents, _typeEvents[type]);
+}
+
+void EventStream::showAllTypes()
+{
+    for (int type = 0; type < EVENT_TYPE_COUNT; type++)
+        setTypeHidden(type, false);
 }
 
-int EventStream::resetIgnoredEvents()
+/* Returns 0 on success, or -1 and leaves the previous filter in place */
+int EventStream::setFilter(const QString &text)
 {
-    _currentEvents = _events;
+    if (_filter.parse(text)) {
+        qDebug() << "Bad filter:" << _filter.errorString();
+        return -1;
+    }
+    _filter.evaluate(_table, 0, _published, _filterMatches);
     return 0;
 }
+
+const QString &EventStream::filterError() const
+{
+    return _filter.errorString();
+}
+
+QVector<int> EventStream::visibleEvents() const
+{
+    QVector<int> events;
+    bitmap_indices(visibleBitmap(), events);
+    return events;
+}
+
+/* One bit per event, set if neither its type nor the filter hides it */
+QVector<quint64> EventStream::visibleBitmap() const
+{
+    QVector<quint64> visible = _visibleEvents;
+    bitmap_and(visible, _filterMatches);
+    return visible;
+}
+
+const QVector<int> &EventStream::currentEvents() const
+{
+    return _currentEvents;
+}
+
+void EventStream::setCurrentEvents(const QVector<int> &events)
+{
+    _currentEvents = events;
+}
+
+void EventStream::removeEvents(int row, int count)
+{
+    _currentEvents.remove(row, count);
+}
+
+const struct EventTable &EventStream::table() const
+{
+    return _table;
+}
+
+/* NULL until the file has finished loading */
+const struct RowIndex *EventStream::rowIndex() const
+{
+    if (!_rowIndexReady.fetchAndAddAcquire(0))
+        return NULL;
+    return &_rowIndex;
+}
+
+int EventStream::nandGeometry(struct nand_geometry *geo) const
+{
+    for (int i = 0; i < _published; i++) {
+        if (_table.type.at(i) == EVT_NAND_PARAMETER_READ) {
+            const uint8_t *data;
+            uint32_t size = eventPayload(i, &data);
+            if (!nand_onfi_geometry(data, size, geo))
+                return 0;
+        }
+    }
+    return -1;
+}
+
+QVector<int> EventStream::eventsForRow(quint32 row) const
+{
+    QVector<int> events;
+    const int *found;
+    int count;
+
+    if (!_rowIndexReady.fetchAndAddAcquire(0))
+        return events;
+
+    count = row_index_find(_rowIndex, row, &found);
+    events.resize(count);
+    if (count)
+        memcpy(events.data(), found, count * sizeof(*found));
+    return events;
+}
+
+void EventStream::insertEvents(int row, const int *events, int count)
+{
+    _currentEvents.insert(row, count, 0);
+    memcpy(_currentEvents.data() + row, events, count * sizeof(*events));
+}
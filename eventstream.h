@@ -3,27 +3,139 @@
 
 #include <QObject>
 #include <QVector>
-#include <QIODevice>
+#include <QFile>
+#include <QCache>
+#include <QFuture>
+#include <QAtomicInt>
 #include "event.h"
+#include "bitmap.h"
+#include "eventtable.h"
+#include "eventfilter.h"
+#include "rowindex.h"
+
+/* Memory budget for decoded events kept around for eventAt(), in
+ * megabytes.  Each event costs its packet plus EVENT_CACHE_OVERHEAD.
+ */
+#define EVENT_CACHE_DEFAULT_MB 64
+#define EVENT_CACHE_MAX_MB 1024
+#define EVENT_CACHE_OVERHEAD 256
+
+/* A miss decodes this many rows ahead in the direction of travel */
+#define EVENT_READ_AHEAD 128
+
+/* Events are published to the UI in batches that grow from the first
+ * size to the last, so the first screen shows up right away.
+ */
+#define LOAD_BATCH_FIRST 1024
+#define LOAD_BATCH_MAX 65536
+
+struct nand_geometry;
+
+/* Event types are a single byte */
+#define EVENT_TYPE_COUNT 256
 
 class EventStream : public QObject
 {
     Q_OBJECT
 public:
     explicit EventStream(QObject *parent = 0);
-    int load(QIODevice &source);
-	const Event &eventAt(int offset) const;
+    ~EventStream();
+    int load(const QString &fileName);
+    bool isLoading() const;
+    int loadedCount() const;
+    int totalCount() const;
+    QVector<int> takeLoadedEvents();
+    void appendEvents(const QVector<int> &events);
+	Event eventAt(int offset) const;
 	int count() const;
-    int ignoreEventsOfType(int type);
-    int resetIgnoredEvents();
+
+    /* Decoded event cache.  prefetch() decodes rows that aren't cached
+     * yet, so analyses over a selection don't miss one at a time.
+     */
+    void setCacheBudget(int megabytes);
+    int cacheBudget() const;
+    void prefetch(int row, int count) const;
+    quint64 cacheHits() const;
+    quint64 cacheMisses() const;
+
+    /* Filtering.  These only update the set of visible events; the
+     * row list is changed separately so the model can announce it.
+     */
+    void setTypeHidden(int type, bool hidden);
+    void showAllTypes();
+    int setFilter(const QString &text);
+    const QString &filterError() const;
+    QVector<int> visibleEvents() const;
+    QVector<quint64> visibleBitmap() const;
+    const QVector<int> &currentEvents() const;
+    void setCurrentEvents(const QVector<int> &events);
+    void removeEvents(int row, int count);
+    void insertEvents(int row, const int *events, int count);
+
+    /* Per-event columns, valid for every event handed out so far */
+    const struct EventTable &table() const;
+
+    /* Every event that addressed row, in file order.  Empty until the
+     * file has finished loading.
+     */
+    QVector<int> eventsForRow(quint32 row) const;
+    const struct RowIndex *rowIndex() const;
+
+    /* Chip layout from the first ONFI parameter page handed out so far.
+     * Returns -1 if there isn't one.
+     */
+    int nandGeometry(struct nand_geometry *geo) const;
+
+    /* Payload of an event, straight from the mapping.  Safe to call from
+     * any thread for events already handed out.
+     */
+    uint32_t eventPayload(int index, const uint8_t **data) const;
+
+    /* The whole event, still big-endian, with its size clamped to the
+     * file.  Same threading rules as eventPayload().
+     */
+    const union evt *eventPacket(int index, uint32_t *size) const;
 
 private:
-    QList<Event> _events;
-    QList<Event> _currentEvents;
-    QList<uint32_t> _offsets;
+    QFile _file;
+    const uchar *_base;
+    qint64 _size;
+    const struct evt_metadata *_metadata;
+    QVector<struct evt_metadata> _localMetadata;
+    QVector<uint32_t> _offsets;
+    QVector<int> _currentEvents;
+    QVector<quint64> _typeEvents[EVENT_TYPE_COUNT];
+    QVector<quint64> _visibleEvents;
+    bool _typeHidden[EVENT_TYPE_COUNT];
+    struct EventTable _table;
+    EventFilter _filter;
+    QVector<quint64> _filterMatches;
+    struct RowIndex _rowIndex;
+    mutable QAtomicInt _rowIndexReady;
+    mutable QCache<int, Event> _cache;
+    mutable quint64 _cacheHits;
+    mutable quint64 _cacheMisses;
+    mutable int _lastRow;
+    mutable int _direction;
+
+    /* Background loading.  Events below _loaded have their offsets and
+     * metadata filled in; those below _published have been handed out.
+     */
+    QFuture<void> _loader;
+    QAtomicInt _loaded;
+    mutable QAtomicInt _complete;   // Set just before loadFinished() goes out
+    QAtomicInt _abort;
+    int _published;
+    int _offsetAdjust;
+
+    void loadEvents();
+    Event *decodeEvent(int index) const;
+    Event cacheEvent(int index) const;
 
 signals:
-    
+    void eventsLoaded();
+    void loadFinished();
+
 public slots:
     
 };
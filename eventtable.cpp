@@ -0,0 +1,122 @@
+#include <QtConcurrentMap>
+#include "eventtable.h"
+#include "eventmetrics.h"
+#include "byteswap.h"
+#include "nand.h"
+
+/* Events are grouped into ranges of this many for the parallel fill */
+#define TABLE_RANGE_SIZE 4096
+
+void EventTable::resize(int count)
+{
+	type.resize(count);
+	start.resize(count);
+	end.resize(count);
+	size.resize(count);
+	ce.resize(count);
+	ctrl.resize(count);
+	row.resize(count);
+	column.resize(count);
+	entropy.resize(count);
+}
+
+int EventTable::count() const
+{
+	return type.count();
+}
+
+struct table_range {
+	struct EventTable *table;
+	const uchar *base;
+	qint64 baseSize;
+	const uint32_t *offsets;
+	const struct evt_metadata *fileMetadata;
+	const struct evt_metadata *localMetadata;
+	int first;
+	int last;
+};
+
+static void fill_range(struct table_range &range)
+{
+	quint8 *type = range.table->type.data();
+	qint64 *start = range.table->start.data();
+	qint64 *end = range.table->end.data();
+	quint32 *size = range.table->size.data();
+	qint8 *ce = range.table->ce.data();
+	quint8 *ctrl = range.table->ctrl.data();
+	qint32 *row = range.table->row.data();
+	qint32 *column = range.table->column.data();
+	float *entropy = range.table->entropy.data();
+
+	for (int i = range.first; i < range.last; i++) {
+		const union evt *evt = (const union evt *)(range.base + range.offsets[i]);
+		struct evt_metadata meta;
+		const uint8_t *data;
+		uint32_t evtSize;
+
+		type[i] = EVT_UNKNOWN;
+		start[i] = end[i] = 0;
+		size[i] = 0;
+		ce[i] = -1;
+		ctrl[i] = 0;
+		row[i] = column[i] = -1;
+		entropy[i] = 0;
+
+		if (range.offsets[i] + sizeof(evt->header) > (quint64)range.baseSize)
+			continue;
+		evtSize = qMin((qint64)_ntohl(evt->header.size),
+					   range.baseSize - range.offsets[i]);
+
+		type[i] = evt->header.type;
+		start[i] = _ntohl(evt->header.sec_start) * Q_INT64_C(1000000000)
+				 + _ntohl(evt->header.nsec_start);
+		end[i] = _ntohl(evt->header.sec_end) * Q_INT64_C(1000000000)
+			   + _ntohl(evt->header.nsec_end);
+		size[i] = event_payload(evt, evtSize, &data);
+
+		// Only raw bus events carry the control pins
+		if (evt->header.type == EVT_NAND_UNKNOWN
+		 && evtSize > offsetof(struct evt_nand_unk, ctrl)) {
+			ctrl[i] = evt->nand_unk.ctrl;
+			ce[i] = nand_cs(ctrl[i]) ? 1 : 0;
+		}
+
+		if (range.fileMetadata) {
+			meta = range.fileMetadata[i];
+			event_metadata_swap(&meta);
+		}
+		else
+			meta = range.localMetadata[i];
+
+		if (meta.flags & EVT_META_HAS_ADDRESS) {
+			row[i] = meta.row;
+			column[i] = meta.column;
+		}
+		entropy[i] = meta.entropy / 65536.0f;
+	}
+}
+
+int event_table_fill(struct EventTable &table,
+					 const uchar *base, qint64 baseSize, const uint32_t *offsets,
+					 const struct evt_metadata *fileMetadata,
+					 const struct evt_metadata *localMetadata,
+					 int first, int last)
+{
+	QVector<struct table_range> ranges;
+
+	for (; first < last; first += TABLE_RANGE_SIZE) {
+		struct table_range range;
+		range.table = &table;
+		range.base = base;
+		range.baseSize = baseSize;
+		range.offsets = offsets;
+		range.fileMetadata = fileMetadata;
+		range.localMetadata = localMetadata;
+		range.first = first;
+		range.last = qMin(first + TABLE_RANGE_SIZE, last);
+		ranges.append(range);
+	}
+
+	QtConcurrent::blockingMap(ranges, fill_range);
+	return 0;
+}
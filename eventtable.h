@@ -0,0 +1,36 @@
+#ifndef EVENTTABLE_H
+#define EVENTTABLE_H
+
+#include <QVector>
+#include <stdint.h>
+#include "event-struct.h"
+
+/* The values queries look at, one column per field and one entry per
+ * event in file order.  Filled a range at a time as events load.
+ */
+struct EventTable {
+	QVector<quint8> type;
+	QVector<qint64> start;      // Nanoseconds
+	QVector<qint64> end;
+	QVector<quint32> size;      // Payload bytes
+	QVector<qint8> ce;          // Chip enable pin, -1 if unknown
+	QVector<quint8> ctrl;       // Raw NAND control pins, 0 if unknown
+	QVector<qint32> row;        // NAND row, -1 if no address
+	QVector<qint32> column;     // NAND column, -1 if no address
+	QVector<float> entropy;     // Bits per byte
+
+	void resize(int count);
+	int count() const;
+};
+
+/* Fill in events first to last-1 from a mapped event file, in parallel.
+ * Metadata comes from fileMetadata (file byte order) if it's set, or
+ * localMetadata (host byte order) otherwise.
+ */
+int event_table_fill(struct EventTable &table,
+					 const uchar *base, qint64 baseSize, const uint32_t *offsets,
+					 const struct evt_metadata *fileMetadata,
+					 const struct evt_metadata *localMetadata,
+					 int first, int last);
+
+#endif // EVENTTABLE_H
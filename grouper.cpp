@@ -4,6 +4,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
+#include <stddef.h>
 #include <sys/types.h>
 #include <QFile>
 #include "packet-struct.h"
@@ -691,6 +692,41 @@ int gstate_run(struct state *st) {
     return st_funcs[st->st](st);
 }
 
+/* While an SD command is open, hdr.size holds its allocated size.
+ * Multi-block reads keep appending to result[], so grow it as needed.
+ */
+static struct evt_sd_cmd *sd_cmd_reserve(struct evt_sd_cmd *evt, uint32_t count) {
+    uint32_t size = _ntohl(evt->hdr.size);
+    uint32_t needed = offsetof(struct evt_sd_cmd, result) + evt->num_results + count;
+    struct evt_sd_cmd *grown;
+
+    if (needed <= size)
+        return evt;
+    while (size < needed)
+        size *= 2;
+    grown = (struct evt_sd_cmd *)realloc(evt, size);
+    if (!grown) {
+        fprintf(stderr, "Couldn't grow EVT_SD_CMD to %u bytes\n", size);
+        free(evt);
+        return NULL;
+    }
+    grown->hdr.size = _htonl(size);
+    return grown;
+}
+
+/* Write out only the results we collected, and free the event */
+static int sd_cmd_write(struct state *st, struct evt_sd_cmd *evt) {
+    uint32_t size = offsetof(struct evt_sd_cmd, result) + evt->num_results;
+    int ret;
+
+    evt->hdr.size = _htonl(size);
+    evt->num_results = _htonl(evt->num_results);
+    evt->num_args = _htonl(evt->num_args);
+    ret = st->out_fdh->write((char *)evt, size);
+    free(evt);
+    return ret == (int)size ? 0 : -1;
+}
+
 void *evt_take(struct state *st, int type) {
     unsigned int i;
     for (i=0; i<(sizeof(st->events)/sizeof(st->events[0])); i++) {
@@ -815,6 +851,13 @@ static int st_scanning(struct state *st) {
         else if (pkt.header.type == PACKET_SD_CMD_ARG) {
 			struct evt_sd_cmd *evt = (struct evt_sd_cmd *)evt_take(st, EVT_SD_CMD);
             struct pkt_sd_cmd_arg *sd = &pkt.data.sd_cmd_arg;
+
+            // A new command ends a multi-block read (usually it's CMD12)
+            if (evt && evt->cmd == 18 && evt->num_results && sd->reg == 0) {
+                sd_cmd_write(st, evt);
+                evt = NULL;
+            }
+
             if (!evt) {
 				evt = (struct evt_sd_cmd *)malloc(sizeof(struct evt_sd_cmd));
                 memset(evt, 0, sizeof(*evt));
@@ -824,7 +867,8 @@ static int st_scanning(struct state *st) {
 
             // Ignore args for CMD55
             if ((evt->num_args || sd->reg>0) && evt->cmd != (55|0x80)) {
-                evt->args[evt->num_args++] = sd->val;
+                if (evt->num_args < sizeof(evt->args))
+                    evt->args[evt->num_args++] = sd->val;
             }
 
             // Register 0 implies this is a CMD.
@@ -840,45 +884,48 @@ static int st_scanning(struct state *st) {
         }
         else if (pkt.header.type == PACKET_SD_RESPONSE) {
 			struct evt_sd_cmd *evt = (struct evt_sd_cmd *)evt_take(st, EVT_SD_CMD);
-            // Ignore CMD17, as we'll pick it up on the PACKET_SD_DATA packet
+            struct pkt_sd_response *sd = &pkt.data.response;
+            if (!evt) {
+                fprintf(stderr, "Couldn't find old EVT_SD_CMD in SD_RESPONSE\n");
+                continue;
+            }
+
+            // Ignore CMD17 and CMD18, as we'll pick them up on the
+            // PACKET_SD_DATA packets.
             // Also ignore CMD55, as it'll become an ACMD later on
-            if (evt->cmd == 17 || evt->cmd == (55|0x80)) {
+            if (evt->cmd == 17 || evt->cmd == 18 || evt->cmd == (55|0x80)) {
                 evt_put(st, evt);
             }
             else {
-                struct pkt_sd_response *sd = &pkt.data.response;
-                if (!evt) {
-                    fprintf(stderr, "Couldn't find old EVT_SD_CMD in SD_RESPONSE\n");
+                evt = sd_cmd_reserve(evt, 1);
+                if (!evt)
                     continue;
-                }
-
                 evt->result[evt->num_results++] = sd->byte;
-                evt->num_results = _htonl(evt->num_results);
-                evt->num_args = _htonl(evt->num_args);
-
                 evt_fill_end(evt, pkt.header.sec, pkt.header.nsec);
-				st->out_fdh->write((char *)evt, _ntohl(evt->hdr.size));
-                free(evt);
+                sd_cmd_write(st, evt);
             }
         }
 
         else if (pkt.header.type == PACKET_SD_DATA) {
 			struct evt_sd_cmd *evt = (struct evt_sd_cmd *)evt_take(st, EVT_SD_CMD);
             struct pkt_sd_data *sd = &pkt.data.sd_data;
-            unsigned int offset;
             if (!evt) {
                 fprintf(stderr, "Couldn't find old SD_EVT_CMD in SD_DATA\n");
                 continue;
             }
 
-            for (offset=0; offset<sizeof(sd->data); offset++)
-                evt->result[evt->num_results++] = sd->data[offset];
-
-            evt->num_results = _htonl(evt->num_results);
-            evt->num_args = _htonl(evt->num_args);
+            evt = sd_cmd_reserve(evt, sizeof(sd->data));
+            if (!evt)
+                continue;
+            memcpy(evt->result + evt->num_results, sd->data, sizeof(sd->data));
+            evt->num_results += sizeof(sd->data);
             evt_fill_end(evt, pkt.header.sec, pkt.header.nsec);
-            st->out_fdh->write((char *)evt, _ntohl(evt->hdr.size));
-            free(evt);
+
+            // CMD18 keeps sending blocks until the next command
+            if (evt->cmd == 18)
+                evt_put(st, evt);
+            else
+                sd_cmd_write(st, evt);
         }
 
         else {
@@ -886,6 +933,13 @@ static int st_scanning(struct state *st) {
         }
     }
 
+    // Flush a multi-block read that ran to the end of the capture
+    struct evt_sd_cmd *sd_evt = (struct evt_sd_cmd *)evt_take(st, EVT_SD_CMD);
+    if (sd_evt && sd_evt->cmd == 18 && sd_evt->num_results)
+        sd_cmd_write(st, sd_evt);
+    else if (sd_evt)
+        evt_put(st, sd_evt);
+
     return ret;
 }
 
@@ -0,0 +1,164 @@
+#include <QPainter>
+#include <QMouseEvent>
+#include <QToolTip>
+#include <math.h>
+#include "heatmapview.h"
+#include "eventitemmodel.h"
+
+/* Pages nothing touched */
+#define HEATMAP_EMPTY qRgb(235, 235, 235)
+
+HeatmapView::HeatmapView(QWidget *parent) :
+	QWidget(parent),
+	_model(NULL),
+	_ready(false),
+	_mode(ColourByCount)
+{
+	// Cold to hot: blue through green and yellow to red
+	for (int i = 0; i < 256; i++)
+		_ramp[i] = QColor::fromHsvF(.66 * (255 - i) / 255, .85, .95).rgb();
+	setMouseTracking(true);
+}
+
+void HeatmapView::setModel(EventItemModel *model)
+{
+	_model = model;
+	connect(_model, SIGNAL(loadFinished()), this, SLOT(refresh()));
+	connect(_model, SIGNAL(rowsFiltered()), this, SLOT(refresh()));
+}
+
+/* Recount for the events showing now.  Rows are only indexed once the
+ * file has loaded, so there's nothing to do before then.
+ */
+void HeatmapView::refresh()
+{
+	const struct RowIndex *index = _model ? _model->events().rowIndex() : NULL;
+	if (!index)
+		return;
+
+	if (!_ready) {
+		struct nand_geometry geo;
+		bool onfi = !_model->events().nandGeometry(&geo);
+		nand_heatmap_layout(_heatmap, onfi ? &geo : NULL, *index);
+		_ready = true;
+	}
+
+	_visible = _model->events().visibleBitmap();
+	nand_heatmap_fill(_heatmap, _model->table(), *index, _visible);
+	recolour();
+}
+
+void HeatmapView::setColourMode(int mode)
+{
+	_mode = mode;
+	recolour();
+}
+
+/* Colours come straight from the cells, so switching modes is cheap */
+void HeatmapView::recolour()
+{
+	if (!_ready || !_model)
+		return;
+
+	const struct nand_geometry *geo = &_heatmap.geometry;
+	const struct EventTable &table = _model->table();
+	int width = geo->pages_per_block;
+	int height = geo->blocks_per_lun * geo->luns;
+	double countScale = 254.0 / log((double)qMax(2u, _heatmap.maxCount));
+	qint64 first = 0, span = 1;
+
+	if (table.count()) {
+		first = table.start.at(0);
+		span = qMax((qint64)1, table.start.at(table.count() - 1) - first);
+	}
+
+	if (_image.width() != width || _image.height() != height)
+		_image = QImage(width, height, QImage::Format_RGB32);
+
+	for (int y = 0; y < height; y++) {
+		QRgb *line = (QRgb *)_image.scanLine(y);
+		const struct heat_cell *cell = _heatmap.cells.constData() + y * width;
+		for (int x = 0; x < width; x++, cell++) {
+			int value;
+			if (!cell->count) {
+				line[x] = HEATMAP_EMPTY;
+				continue;
+			}
+
+			if (_mode == ColourByLastAccess)
+				value = (table.start.at(cell->last) - first) * 255 / span;
+			else if (_mode == ColourByEntropy)
+				value = cell->entropy;
+			else
+				value = 1 + (int)(log((double)cell->count) * countScale);
+			line[x] = _ramp[qBound(0, value, 255)];
+		}
+	}
+	update();
+}
+
+void HeatmapView::paintEvent(QPaintEvent *)
+{
+	QPainter painter(this);
+	if (!_ready) {
+		painter.drawText(rect(), Qt::AlignCenter, "Waiting for events to load...");
+		return;
+	}
+	painter.drawImage(rect(), _image);
+}
+
+int HeatmapView::pageAt(const QPoint &pos) const
+{
+	if (!_ready || !rect().contains(pos) || _image.isNull())
+		return -1;
+	int x = pos.x() * _image.width() / width();
+	int y = pos.y() * _image.height() / height();
+	return y * _image.width() + x;
+}
+
+void HeatmapView::mouseMoveEvent(QMouseEvent *event)
+{
+	int page = pageAt(event->pos());
+	if (page < 0) {
+		QToolTip::hideText();
+		return;
+	}
+
+	const struct nand_geometry *geo = &_heatmap.geometry;
+	const struct heat_cell &cell = _heatmap.cells.at(page);
+	const struct EventTable &table = _model->table();
+	quint32 row = nand_page_row(geo, page);
+	uint32_t block = page / geo->pages_per_block;
+	QString text = QString("LUN %1 block %2 page %3 (row %4): %5 accesses")
+			.arg(block / geo->blocks_per_lun)
+			.arg(block % geo->blocks_per_lun)
+			.arg(page % geo->pages_per_block)
+			.arg(row)
+			.arg(cell.count);
+
+	QVector<int> events = _model->eventsForRow(row);
+	int shown = 0;
+	for (int i = 0; i < events.count() && shown < HEATMAP_TOOLTIP_MAX; i++) {
+		int index = events.at(i);
+		if (!bitmap_test(_visible, index))
+			continue;
+		text += QString("\n#%1 %2 at %3.%4")
+				.arg(index)
+				.arg(EventTypes().value(table.type.at(index)).mid(4))
+				.arg(table.start.at(index) / 1000000000)
+				.arg(table.start.at(index) % 1000000000, 9, 10, QLatin1Char('0'));
+		shown++;
+	}
+	if (cell.count > (quint32)shown)
+		text += QString("\n...and %1 more").arg(cell.count - shown);
+
+	QToolTip::showText(event->globalPos(), text, this);
+}
+
+/* Clicking a page selects its most recent access */
+void HeatmapView::mousePressEvent(QMouseEvent *event)
+{
+	int page = pageAt(event->pos());
+	if (page >= 0 && _heatmap.cells.at(page).last >= 0)
+		emit eventClicked(_heatmap.cells.at(page).last);
+}
@@ -0,0 +1,55 @@
+#ifndef HEATMAPVIEW_H
+#define HEATMAPVIEW_H
+
+#include <QWidget>
+#include <QImage>
+#include <QVector>
+#include "nandheatmap.h"
+
+/* Events listed when hovering over a page */
+#define HEATMAP_TOOLTIP_MAX 20
+
+class EventItemModel;
+
+/* The chip as a grid, one block per line and one page per column,
+ * coloured by what the events currently showing did to each page.
+ */
+class HeatmapView : public QWidget
+{
+	Q_OBJECT
+public:
+	enum {
+		ColourByCount,
+		ColourByLastAccess,
+		ColourByEntropy,
+	};
+
+	explicit HeatmapView(QWidget *parent = 0);
+	void setModel(EventItemModel *model);
+
+signals:
+	void eventClicked(int index);
+
+public slots:
+	void refresh();
+	void setColourMode(int mode);
+
+protected:
+	void paintEvent(QPaintEvent *event);
+	void mouseMoveEvent(QMouseEvent *event);
+	void mousePressEvent(QMouseEvent *event);
+
+private:
+	EventItemModel *_model;
+	struct NandHeatmap _heatmap;
+	QVector<quint64> _visible;
+	bool _ready;
+	int _mode;
+	QImage _image;
+	QRgb _ramp[256];
+
+	void recolour();
+	int pageAt(const QPoint &pos) const;
+};
+
+#endif // HEATMAPVIEW_H
@@ -17,7 +17,8 @@ HexWindow::~HexWindow()
 
 void HexWindow::setData(const QByteArray &data)
 {
-	_data = data;
+	// Take a deep copy, as event payloads are views into the event
+	_data = QByteArray(data.constData(), data.size());
 	ui->hexView->setData(_data);
 }
 
@@ -1,73 +1,190 @@
-
-#include <QGraphicsScene>
-#include <QGraphicsLineItem>
+#include <QPainter>
 #include <QDebug>
 #include <QPlainTextEdit>
 #include <QMouseEvent>
+#include <QToolTip>
+#include <algorithm>
+#include <functional>
+#include <string.h>
+#include <math.h>
 #include "histogramview.h"
-
-static bool numericalLessThan(QPair<int,int> i1, QPair<int,int> i2)
-{
-	if (i1.second < i2.second)
-		return true;
-	if (i1.second > i2.second)
-		return false;
-	if (i1.first < i2.first)
-		return true;
-	return false;
-}
+#include "entropy.h"
 
 HistogramView::HistogramView(QWidget *parent) :
-    QWidget(parent)
+    QWidget(parent),
+	mouseY(0),
+	_mode(ShowBytes),
+	statsOutput(NULL),
+	_textStale(false),
+	_maxCount(0),
+	_bigramsStale(false)
 {
-	statsOutput = NULL;
-}
+	memset(_counts, 0, sizeof(_counts));
 
+	// Empty bins stay white; the rest run blue through to red
+	_ramp[0] = qRgb(255, 255, 255);
+	for (int i = 1; i < 256; i++)
+		_ramp[i] = QColor::fromHsvF(.66 * (255 - i) / 255, .85, .95).rgb();
 
-void HistogramView::setData(const QByteArray &newData)
+	setMouseTracking(true);
+}
+
+/* stats must describe newData; the caller has usually worked them out
+ * already for the entropy report.
+ */
+void HistogramView::setData(const QByteArray &newData, const struct byte_stats &stats)
 {
 	unsigned int index;
 
 	data = newData;
-	setMouseTracking(true);
 
-	buckets.clear();
-	for (index=0; index<MAX_VALUE; index++)
-		buckets.append(QPair<int,int>(index, 0));
-
-	for(index = 0; index < (unsigned int) newData.size(); index++) {
-		buckets[newData.at(index) & 0xff].second++;
+	_maxCount = 0;
+	for (index=0; index<MAX_VALUE; index++) {
+		_counts[index] = stats.hist[index];
+		_maxCount = qMax(_maxCount, _counts[index]);
 	}
 
-	sortedBuckets = buckets;
-	qSort(sortedBuckets.begin(), sortedBuckets.end(), numericalLessThan);
+	_bigramsStale = true;
+	if (_mode == ShowBigrams)
+		updateBigrams();
 
-	/////// text box update
-	if (statsOutput) {
-		QString histVals = "";
-		for(index=0; index<MAX_VALUE; index++) {
-			histVals += QString("0x%1 occurs %2 times\n")
-						.arg(sortedBuckets[index].first, 2, 16)
-						.arg(sortedBuckets[index].second);
-		}
-		statsOutput->clear();
-		statsOutput->appendPlainText(histVals);
-	}
+	_textStale = true;
+	updateText();
 
     update();
 }
 
 void HistogramView::setStatsOutput(QPlainTextEdit *newStatsOutput)
 {
+	if (statsOutput)
+		statsOutput->removeEventFilter(this);
 	statsOutput = newStatsOutput;
+	if (statsOutput)
+		statsOutput->installEventFilter(this);
+}
+
+void HistogramView::setMode(int mode)
+{
+	_mode = mode;
+	if (_mode == ShowBigrams && _bigramsStale)
+		updateBigrams();
+	_textStale = true;
+	updateText();
+	update();
+}
+
+/* Counts go through a log scale, as a few pairs (00 00, ff ff) tend to
+ * dwarf everything else.
+ */
+void HistogramView::updateBigrams()
+{
+	if (_bigrams.size() != 65536)
+		_bigrams.resize(65536);
+	bigram_histogram((const uint8_t *)data.constData(), data.size(), _bigrams.data());
+
+	uint32_t max = 1;
+	for (int i = 0; i < 65536; i++)
+		max = qMax(max, _bigrams.at(i));
+	double scale = 254.0 / log(1.0 + max);
+
+	if (_bigramImage.isNull())
+		_bigramImage = QImage(MAX_VALUE, MAX_VALUE, QImage::Format_RGB32);
+	for (int y = 0; y < (int)MAX_VALUE; y++) {
+		QRgb *line = (QRgb *)_bigramImage.scanLine(y);
+		const uint32_t *counts = _bigrams.constData() + y * MAX_VALUE;
+		for (int x = 0; x < (int)MAX_VALUE; x++)
+			line[x] = counts[x] ? _ramp[1 + (int)(log(1.0 + counts[x]) * scale)] : _ramp[0];
+	}
+
+	_bigramsStale = false;
+}
+
+/* The text pane is a few hundred lines of formatting, so it's only
+ * written while it can be seen.  The event filter catches it coming
+ * back into view.
+ */
+void HistogramView::updateText()
+{
+	unsigned int index;
+
+	if (!statsOutput || !_textStale || !statsOutput->isVisible())
+		return;
+
+	QString text;
+	if (_mode == ShowBigrams) {
+		// Most common pairs first
+		quint64 keys[BIGRAM_TEXT_MAX];
+		int count = 0;
+
+		for (index=0; index<(unsigned int)_bigrams.size(); index++) {
+			quint64 key = ((quint64)_bigrams.at(index) << 16) | (0xffff - index);
+			if (!_bigrams.at(index))
+				continue;
+			if (count < BIGRAM_TEXT_MAX) {
+				keys[count++] = key;
+				std::push_heap(keys, keys + count, std::greater<quint64>());
+			}
+			else if (key > keys[0]) {
+				std::pop_heap(keys, keys + count, std::greater<quint64>());
+				keys[count - 1] = key;
+				std::push_heap(keys, keys + count, std::greater<quint64>());
+			}
+		}
+		std::sort(keys, keys + count, std::greater<quint64>());
+
+		for (int i=0; i<count; i++) {
+			int pair = 0xffff - (keys[i] & 0xffff);
+			text += QString("%1 %2 occurs %3 times\n")
+					.arg(pair >> 8, 2, 16, QLatin1Char('0'))
+					.arg(pair & 0xff, 2, 16, QLatin1Char('0'))
+					.arg(keys[i] >> 16);
+		}
+	}
+	else {
+		// Least common first, as before; count then value
+		quint64 keys[MAX_VALUE];
+		for (index=0; index<MAX_VALUE; index++)
+			keys[index] = ((quint64)_counts[index] << 8) | index;
+		std::sort(keys, keys + MAX_VALUE);
+
+		for (index=0; index<MAX_VALUE; index++) {
+			text += QString("0x%1 occurs %2 times\n")
+					.arg(keys[index] & 0xff, 2, 16)
+					.arg(keys[index] >> 8);
+		}
+	}
+
+	statsOutput->clear();
+	statsOutput->appendPlainText(text);
+	_textStale = false;
+}
+
+bool HistogramView::eventFilter(QObject *watched, QEvent *event)
+{
+	if (watched == statsOutput && event->type() == QEvent::Show)
+		updateText();
+	return QWidget::eventFilter(watched, event);
 }
 
 void HistogramView::mouseMoveEvent(QMouseEvent *event)
 {
+	if (_mode == ShowBigrams) {
+		if (_bigrams.isEmpty() || !rect().contains(event->pos()))
+			return;
+		int first = event->y() * MAX_VALUE / height();
+		int second = event->x() * MAX_VALUE / width();
+		int pair = (first << 8) | second;
+		QToolTip::showText(event->globalPos(), QString("%1 %2: %3")
+				.arg(first, 2, 16, QLatin1Char('0'))
+				.arg(second, 2, 16, QLatin1Char('0'))
+				.arg(_bigrams.at(pair)), this);
+		return;
+	}
+
 	qreal percentage = ((qreal)MAX_VALUE)/((qreal)width());
-	mouseY = percentage * event->x();
-	setToolTip(QString("Value at %1: %2").arg((long)mouseY,2,16).arg(buckets[mouseY].second));
-	setStatusTip(QString("Value at %1: %2").arg((long)mouseY,2,16).arg(buckets[mouseY].second));
+	mouseY = qMin((unsigned int)(percentage * event->x()), MAX_VALUE - 1);
+	setToolTip(QString("Value at %1: %2").arg((long)mouseY,2,16).arg(_counts[mouseY]));
+	setStatusTip(QString("Value at %1: %2").arg((long)mouseY,2,16).arg(_counts[mouseY]));
 	update();
 }
 
@@ -84,27 +201,27 @@ void HistogramView::paintEvent(QPaintEvent *event)
 	qreal lineWidth = width/MAX_VALUE/2;
 	qreal lineHeight = height;
 
-	if (data.size() > 0) {
-
-		float yscale = 0.0;
-		for(index = 0; index < buckets.count(); index++) {
-			if (yscale < buckets[index].second) {
-				yscale = buckets[index].second;
-            }
-        }
-
-		painter.setPen(pen);
-		for(index = 0; index < buckets.count(); index++) {
-			if (mouseY == index)
-				painter.setPen(bluePen);
-			else
-				painter.setPen(pen);
-			painter.drawLine(
-						index*2*lineWidth,
-						lineHeight - (buckets[index].second * lineHeight / yscale) + 3.0,
-						index*2*lineWidth,
-						lineHeight + 3.0);
-		}
+	if (data.size() == 0)
+		return;
 
-    }
+	// First byte down, second across
+	if (_mode == ShowBigrams) {
+		painter.drawImage(rect(), _bigramImage);
+		return;
+	}
+
+	float yscale = _maxCount;
+
+	painter.setPen(pen);
+	for(index = 0; index < MAX_VALUE; index++) {
+		if (mouseY == index)
+			painter.setPen(bluePen);
+		else
+			painter.setPen(pen);
+		painter.drawLine(
+					index*2*lineWidth,
+					lineHeight - (_counts[index] * lineHeight / yscale) + 3.0,
+					index*2*lineWidth,
+					lineHeight + 3.0);
+	}
 }
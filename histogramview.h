@@ -1,38 +1,62 @@
 #ifndef HISTOGRAMVIEW_H
 #define HISTOGRAMVIEW_H
 
-#include <QGraphicsView>
-#include <QList>
-#include <QPair>
+#include <QWidget>
+#include <QImage>
+#include <QVector>
+#include <stdint.h>
+
+/* Byte pairs listed in the text pane in bigram mode */
+#define BIGRAM_TEXT_MAX 256
 
 class QPlainTextEdit;
+struct byte_stats;
 
 class HistogramView : public QWidget
 {
     Q_OBJECT
 
-private:
-	QByteArray data;
-	unsigned int mouseY;
-	static const unsigned int MAX_VALUE = 256;
-
-	QPlainTextEdit *statsOutput;
-
-	QList<QPair<int,int> > buckets;
-	QList<QPair<int,int> > sortedBuckets;
-
 public:
+	enum {
+		ShowBytes,
+		ShowBigrams,
+	};
+
     explicit HistogramView(QWidget *parent = 0);
-	void setData(const QByteArray &newData);
+	void setData(const QByteArray &newData, const struct byte_stats &stats);
 	void setStatsOutput(QPlainTextEdit *newStatsOutput);
 
 signals:
     
 public slots:
-    
+	void setMode(int mode);
+
 protected:
     void paintEvent(QPaintEvent *event);
 	void mouseMoveEvent(QMouseEvent *event);
+	bool eventFilter(QObject *watched, QEvent *event);
+
+private:
+	static const unsigned int MAX_VALUE = 256;
+
+	QByteArray data;
+	unsigned int mouseY;
+	int _mode;
+
+	QPlainTextEdit *statsOutput;
+	bool _textStale;
+
+	uint32_t _counts[MAX_VALUE];
+	uint32_t _maxCount;
+
+	/* Bigram counts, only worked out while they're on show */
+	QVector<uint32_t> _bigrams;
+	bool _bigramsStale;
+	QImage _bigramImage;
+	QRgb _ramp[256];
+
+	void updateBigrams();
+	void updateText();
 };
 
 #endif // HISTOGRAMVIEW_H
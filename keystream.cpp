@@ -0,0 +1,138 @@
+#include <QtConcurrentMap>
+#include <string.h>
+#include "keystream.h"
+
+/* Positions per job.  Each job counts every page of its stream over its
+ * window, so the counters stay small however many pages there are.
+ */
+#define KEYSTREAM_WINDOW 1024
+
+/* Pages counted into 16-bit bins before they're added to the totals */
+#define KEYSTREAM_CHUNK 65535
+
+/* One window of one stream: 256 counters per position, the most common
+ * byte wins.
+ */
+struct window_job {
+	const QVector<struct keystream_page> *pages;
+	int first;                      // Positions [first, first + length)
+	int length;
+	uint8_t *winner;                // Into the stream's keystream
+	qint64 agreeing;
+	qint64 total;
+};
+
+static void count_window(struct window_job &job)
+{
+	QVector<quint16> counts(job.length * 256);
+	QVector<quint32> totals(job.length * 256);
+	int end = job.first + job.length;
+	int p, i;
+
+	for (p = 0; p < job.pages->count(); p++) {
+		const struct keystream_page &page = job.pages->at(p);
+		int last = qMin(end, (int)page.size);
+		quint16 *bins = counts.data() - job.first * 256;
+
+		for (i = job.first; i < last; i++)
+			bins[i * 256 + page.data[i]]++;
+
+		if ((p + 1) % KEYSTREAM_CHUNK == 0 || p + 1 == job.pages->count()) {
+			for (i = 0; i < totals.count(); i++)
+				totals[i] += counts.at(i);
+			counts.fill(0);
+		}
+	}
+
+	job.agreeing = 0;
+	job.total = 0;
+	for (i = 0; i < job.length; i++) {
+		const quint32 *bins = totals.constData() + i * 256;
+		int best = 0;
+		for (int b = 0; b < 256; b++) {
+			job.total += bins[b];
+			if (bins[b] > bins[best])
+				best = b;
+		}
+		job.winner[i] = best;
+		job.agreeing += bins[best];
+	}
+}
+
+int keystream_recover(const QVector<struct keystream_page> &pages, int period,
+					  quint8 plaintext, struct Keystream *keystream)
+{
+	QVector<QVector<struct keystream_page> > byStream(period);
+	QVector<struct window_job> jobs;
+	int i, k;
+
+	for (i = 0; i < pages.count(); i++) {
+		const struct keystream_page &page = pages.at(i);
+		if (period == 1)
+			byStream[0].append(page);
+		else if (page.row >= 0)
+			byStream[page.row % period].append(page);
+	}
+
+	keystream->period = period;
+	keystream->plaintext = plaintext;
+	keystream->streams.fill(QByteArray(), period);
+	keystream->pages.fill(0, period);
+
+	for (k = 0; k < period; k++) {
+		const QVector<struct keystream_page> &stream = byStream.at(k);
+		uint32_t length = 0;
+
+		keystream->pages[k] = stream.count();
+		for (i = 0; i < stream.count(); i++)
+			length = qMax(length, stream.at(i).size);
+		keystream->streams[k] = QByteArray(length, 0);
+
+		for (uint32_t first = 0; first < length; first += KEYSTREAM_WINDOW) {
+			struct window_job job;
+			job.pages = &stream;
+			job.first = first;
+			job.length = qMin((uint32_t)KEYSTREAM_WINDOW, length - first);
+			job.winner = (uint8_t *)keystream->streams[k].data() + first;
+			jobs.append(job);
+		}
+	}
+	if (jobs.isEmpty())
+		return -1;
+
+	QtConcurrent::blockingMap(jobs, count_window);
+
+	keystream->agreeing = 0;
+	keystream->total = 0;
+	for (i = 0; i < jobs.count(); i++) {
+		keystream->agreeing += jobs.at(i).agreeing;
+		keystream->total += jobs.at(i).total;
+	}
+
+	// What was read is keystream ^ plaintext
+	for (k = 0; k < period; k++) {
+		QByteArray &stream = keystream->streams[k];
+		char *data = stream.data();
+		for (i = 0; i < stream.size(); i++)
+			data[i] ^= plaintext;
+	}
+
+	return 0;
+}
+
+const QByteArray *keystream_for_row(const struct Keystream &keystream, int row)
+{
+	int k;
+
+	if (keystream.streams.isEmpty())
+		return NULL;
+	if (keystream.period == 1)
+		k = 0;
+	else if (row < 0)
+		return NULL;
+	else
+		k = row % keystream.period;
+
+	const QByteArray &stream = keystream.streams.at(k);
+	return stream.isEmpty() ? NULL : &stream;
+}
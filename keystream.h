@@ -0,0 +1,40 @@
+#ifndef KEYSTREAM_H
+#define KEYSTREAM_H
+
+#include <QVector>
+#include <QByteArray>
+#include <stdint.h>
+
+/* A page to learn from and the NAND row it was read from.  data points
+ * into the mapped event file, so it stays valid for the stream's life.
+ */
+struct keystream_page {
+	const uint8_t *data;
+	uint32_t size;
+	int row;
+};
+
+/* Scrambler keystreams, one for each NAND row modulo period.  Each is the
+ * most common byte at every position across that stream's pages, XORed
+ * with the plaintext they're assumed to hold (0x00 or 0xff for blank
+ * pages).
+ */
+struct Keystream {
+	int period;
+	quint8 plaintext;
+	QVector<QByteArray> streams;    // By row % period, empty where no page fell
+	QVector<int> pages;             // Pages behind each stream
+	qint64 agreeing;                // Sampled bytes equal to their position's winner
+	qint64 total;                   // Sampled bytes
+};
+
+/* Work out keystreams from pages, in parallel.  With a period above one,
+ * pages need a row.  Returns -1 if no stream could be built.
+ */
+int keystream_recover(const QVector<struct keystream_page> &pages, int period,
+					  quint8 plaintext, struct Keystream *keystream);
+
+/* The keystream to use on a page from row, or NULL if there isn't one */
+const QByteArray *keystream_for_row(const struct Keystream &keystream, int row);
+
+#endif // KEYSTREAM_H
@@ -0,0 +1,433 @@
+#include <QtConcurrentMap>
+#include <QThread>
+#include "lfsr.h"
+
+/* Output bits every candidate must reproduce before it's checked against
+ * the whole page.  Candidates run in lockstep, 64 seeds per word: word j
+ * holds bit j of all 64 states, so one step is a handful of word XORs.
+ * Nearly every lane is dead within a few bits, and a word is dropped as
+ * soon as all of its lanes are.
+ */
+#define LFSR_MATCH_BITS 64
+
+/* Mismatches a lane may have in those bits and live, so a flipped bit
+ * near the start of the page doesn't hide the generator.
+ */
+#define LFSR_MATCH_ERRORS 2
+
+/* A candidate has to reproduce this share of the page's bits.  Erased
+ * pages carry the odd flipped bit.
+ */
+#define LFSR_CONFIRM_PERCENT 99
+
+/* Matches kept per job; more are just the same sequence again */
+#define LFSR_MATCH_MAX 16
+
+/* Bit j of the lane number, for the low six bits of 64 consecutive seeds */
+static const quint64 lane_bits[6] = {
+	0xaaaaaaaaaaaaaaaaULL,
+	0xccccccccccccccccULL,
+	0xf0f0f0f0f0f0f0f0ULL,
+	0xff00ff00ff00ff00ULL,
+	0xffff0000ffff0000ULL,
+	0xffffffff00000000ULL,
+};
+
+/* The bits a page's keystream starts with, one all-zeros or all-ones
+ * word per bit so they compare straight against a slice.
+ */
+struct lfsr_target {
+	QByteArray keystream;
+	quint64 lsb[LFSR_MATCH_BITS];
+	quint64 msb[LFSR_MATCH_BITS];
+};
+
+struct lfsr_match {
+	quint32 poly;
+	quint32 seed;
+	bool msbFirst;
+	int agreeing;
+};
+
+static void generate(quint32 poly, quint32 state, bool msbFirst, uint8_t *out, size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		uint8_t byte = 0;
+		for (int b = 0; b < 8; b++) {
+			uint8_t bit = state & 1;
+			state >>= 1;
+			if (bit)
+				state ^= poly;
+			byte |= bit << (msbFirst ? 7 - b : b);
+		}
+		out[i] = byte;
+	}
+}
+
+static int make_target(const struct keystream_page &page, quint8 plaintext,
+					   struct lfsr_target &target)
+{
+	const uint8_t *data = page.data;
+	uint32_t size = page.size;
+
+	if (size * 8 < LFSR_MATCH_BITS)
+		return -1;
+
+	target.keystream = QByteArray((const char *)data, size);
+	for (uint32_t i = 0; i < size; i++)
+		target.keystream[i] = target.keystream.at(i) ^ plaintext;
+
+	for (int k = 0; k < LFSR_MATCH_BITS; k++) {
+		uint8_t byte = target.keystream.at(k / 8);
+		target.lsb[k] = (byte >> (k % 8)) & 1 ? ~0ULL : 0;
+		target.msb[k] = (byte >> (7 - k % 8)) & 1 ? ~0ULL : 0;
+	}
+	return 0;
+}
+
+/* Load seeds [base, base + 64) of a degree bit register into slices */
+static void slice_load(int degree, quint32 base, quint64 *s)
+{
+	for (int j = 0; j < degree; j++)
+		s[j] = j < 6 ? lane_bits[j] : ((base >> j) & 1 ? ~0ULL : 0);
+}
+
+/* Step every lane once, returning the bits that fell off */
+static inline quint64 slice_step(int degree, const quint64 *taps, quint64 *s)
+{
+	quint64 out = s[0];
+	for (int j = 0; j < degree - 1; j++)
+		s[j] = s[j + 1] ^ (out & taps[j]);
+	s[degree - 1] = out;
+	return out;
+}
+
+/* Lanes with more than e mismatches so far, for each e up to the limit */
+static inline void count_errors(quint64 *over, quint64 err)
+{
+	for (int e = LFSR_MATCH_ERRORS; e > 0; e--)
+		over[e] |= over[e - 1] & err;
+	over[0] |= err;
+}
+
+/* Run seeds [base, base + 64) of one register against the target.  Lanes
+ * within LFSR_MATCH_ERRORS of it after LFSR_MATCH_BITS come back set, per
+ * bit order.
+ */
+static void slice_seeds(int degree, const quint64 *taps, quint32 base,
+						const struct lfsr_target &target,
+						quint64 *lsbAlive, quint64 *msbAlive)
+{
+	quint64 s[LFSR_DEGREE_MAX];
+	quint64 lsbOver[LFSR_MATCH_ERRORS + 1], msbOver[LFSR_MATCH_ERRORS + 1];
+	quint64 dead = 0;
+	int e, k;
+
+	slice_load(degree, base, s);
+
+	// Seed 0 never leaves zero, and short registers don't fill a word
+	if (!base)
+		dead = 1;
+	if (degree < 6)
+		dead |= ~0ULL << (1 << degree);
+	for (e = 0; e <= LFSR_MATCH_ERRORS; e++)
+		lsbOver[e] = msbOver[e] = dead;
+
+	for (k = 0; k < LFSR_MATCH_BITS; k++) {
+		quint64 out = slice_step(degree, taps, s);
+
+		count_errors(lsbOver, out ^ target.lsb[k]);
+		count_errors(msbOver, out ^ target.msb[k]);
+		if (!~(lsbOver[LFSR_MATCH_ERRORS] & msbOver[LFSR_MATCH_ERRORS]))
+			break;
+	}
+
+	*lsbAlive = ~lsbOver[LFSR_MATCH_ERRORS];
+	*msbAlive = ~msbOver[LFSR_MATCH_ERRORS];
+}
+
+static int agreement(int degree, quint32 poly, quint32 seed, bool msbFirst,
+					 const QByteArray &keystream)
+{
+	QByteArray generated(keystream.size(), 0);
+	int agreeing = 0;
+
+	generate(poly, seed, msbFirst, (uint8_t *)generated.data(), generated.size());
+	for (int i = 0; i < keystream.size(); i++) {
+		uint8_t diff = generated.at(i) ^ keystream.at(i);
+		agreeing += 8;
+		while (diff) {
+			agreeing--;
+			diff &= diff - 1;
+		}
+	}
+	return agreeing;
+}
+
+static bool confirmed(int agreeing, const QByteArray &keystream)
+{
+	return agreeing * 100LL >= keystream.size() * 8LL * LFSR_CONFIRM_PERCENT;
+}
+
+/* Every seed of every register in [polyFirst, polyLast) */
+struct poly_job {
+	const struct lfsr_target *target;
+	int degree;
+	quint32 polyFirst;
+	quint32 polyLast;
+	bool fixedOrder;            // Seed search for a known generator
+	bool msbFirst;
+	const QAtomicInt *cancel;
+	QVector<struct lfsr_match> matches;
+};
+
+static void check_lanes(struct poly_job &job, quint32 poly, quint32 base,
+						quint64 alive, bool msbFirst)
+{
+	while (alive && job.matches.count() < LFSR_MATCH_MAX) {
+		int lane = __builtin_ctzll(alive);
+		alive &= alive - 1;
+
+		struct lfsr_match match;
+		match.poly = poly;
+		match.seed = base + lane;
+		match.msbFirst = msbFirst;
+		match.agreeing = agreement(job.degree, poly, match.seed, msbFirst,
+								   job.target->keystream);
+		if (confirmed(match.agreeing, job.target->keystream))
+			job.matches.append(match);
+	}
+}
+
+static void search_polys(struct poly_job &job)
+{
+	quint64 taps[LFSR_DEGREE_MAX];
+	quint32 seeds = 1U << job.degree;
+
+	for (quint32 poly = job.polyFirst; poly < job.polyLast; poly++) {
+		if (*job.cancel || job.matches.count() >= LFSR_MATCH_MAX)
+			return;
+
+		for (int j = 0; j < job.degree; j++)
+			taps[j] = (poly >> j) & 1 ? ~0ULL : 0;
+
+		for (quint32 base = 0; base < seeds; base += 64) {
+			quint64 lsbAlive, msbAlive;
+			slice_seeds(job.degree, taps, base, *job.target, &lsbAlive, &msbAlive);
+			if (!job.fixedOrder || !job.msbFirst)
+				check_lanes(job, poly, base, lsbAlive, false);
+			if (!job.fixedOrder || job.msbFirst)
+				check_lanes(job, poly, base, msbAlive, true);
+		}
+	}
+}
+
+/* The best of the jobs' matches: most bits explained, then lowest poly */
+static int best_match(const QVector<struct poly_job> &jobs, struct lfsr_match *best)
+{
+	int found = 0;
+
+	for (int i = 0; i < jobs.count(); i++) {
+		for (int m = 0; m < jobs.at(i).matches.count(); m++) {
+			const struct lfsr_match &match = jobs.at(i).matches.at(m);
+			if (!found || match.agreeing > best->agreeing
+			 || (match.agreeing == best->agreeing && match.poly < best->poly)) {
+				*best = match;
+				found = 1;
+			}
+		}
+	}
+	return found ? 0 : -1;
+}
+
+static int find_generator(const struct lfsr_target &target, const struct lfsr_options &options,
+						  struct lfsr_match *best, int *degree)
+{
+	int jobCount = QThread::idealThreadCount() * 16;
+
+	for (int n = 2; n <= options.maxDegree; n++) {
+		QVector<struct poly_job> jobs;
+		quint32 first = 1U << (n - 1);
+		quint32 count = first;
+		quint32 step = qMax(1U, count / jobCount);
+
+		for (quint32 poly = first; poly < first + count; poly += step) {
+			struct poly_job job;
+			job.target = &target;
+			job.degree = n;
+			job.polyFirst = poly;
+			job.polyLast = qMin(poly + step, first + count);
+			job.fixedOrder = false;
+			job.msbFirst = false;
+			job.cancel = options.cancel;
+			jobs.append(job);
+		}
+
+		QtConcurrent::blockingMap(jobs, search_polys);
+		if (*options.cancel)
+			return -1;
+
+		// Longer registers only find multiples of this one
+		if (!best_match(jobs, best)) {
+			*degree = n;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/* A found generator's seed for one more page */
+struct seed_job {
+	struct keystream_page page;
+	const struct LfsrGenerator *generator;
+	quint8 plaintext;
+	const QAtomicInt *cancel;
+	bool found;
+	quint32 seed;
+};
+
+static void find_seed(struct seed_job &job)
+{
+	struct lfsr_target target;
+	struct lfsr_match match;
+	struct poly_job search;
+
+	job.found = false;
+	if (*job.cancel || make_target(job.page, job.plaintext, target))
+		return;
+
+	search.target = &target;
+	search.degree = job.generator->degree;
+	search.polyFirst = job.generator->poly;
+	search.polyLast = job.generator->poly + 1;
+	search.fixedOrder = true;
+	search.msbFirst = job.generator->msbFirst;
+	search.cancel = job.cancel;
+	search_polys(search);
+
+	QVector<struct poly_job> jobs;
+	jobs.append(search);
+	if (!best_match(jobs, &match)) {
+		job.found = true;
+		job.seed = match.seed;
+	}
+}
+
+/* See whether seeds follow from rows by a constant XOR or offset */
+static void find_seed_rule(struct LfsrGenerator *generator)
+{
+	quint32 mask = (1ULL << generator->degree) - 1;
+	bool xorRule = true, addRule = true;
+	quint32 xorConstant = 0, addConstant = 0;
+
+	generator->seedRule = LFSR_SEED_TABLE;
+	generator->seedConstant = 0;
+	if (generator->seeds.count() < 2)
+		return;
+
+	QMap<int, quint32>::const_iterator it = generator->seeds.constBegin();
+	xorConstant = (it.value() ^ (quint32)it.key()) & mask;
+	addConstant = (it.value() - (quint32)it.key()) & mask;
+	for (; it != generator->seeds.constEnd(); ++it) {
+		xorRule = xorRule && ((it.value() ^ (quint32)it.key()) & mask) == xorConstant;
+		addRule = addRule && ((it.value() - (quint32)it.key()) & mask) == addConstant;
+	}
+
+	if (xorRule) {
+		generator->seedRule = LFSR_SEED_XOR_ROW;
+		generator->seedConstant = xorConstant;
+	}
+	else if (addRule) {
+		generator->seedRule = LFSR_SEED_ADD_ROW;
+		generator->seedConstant = addConstant;
+	}
+}
+
+int lfsr_search(const QVector<struct keystream_page> &pages,
+				const struct lfsr_options &options, struct LfsrGenerator *generator)
+{
+	struct lfsr_target target;
+	struct lfsr_match match;
+	int degree, i;
+
+	if (pages.isEmpty() || options.maxDegree < 2 || options.maxDegree > LFSR_DEGREE_MAX)
+		return -1;
+	if (make_target(pages.at(0), options.plaintext, target))
+		return -1;
+	if (find_generator(target, options, &match, &degree))
+		return -1;
+
+	generator->degree = degree;
+	generator->poly = match.poly;
+	generator->msbFirst = match.msbFirst;
+	generator->seeds.clear();
+	generator->pages = 1;
+	if (pages.at(0).row >= 0)
+		generator->seeds.insert(pages.at(0).row, match.seed);
+
+	QVector<struct seed_job> jobs;
+	for (i = 1; i < pages.count(); i++) {
+		struct seed_job job;
+		job.page = pages.at(i);
+		job.generator = generator;
+		job.plaintext = options.plaintext;
+		job.cancel = options.cancel;
+		jobs.append(job);
+	}
+	QtConcurrent::blockingMap(jobs, find_seed);
+	if (*options.cancel)
+		return -1;
+
+	for (i = 0; i < jobs.count(); i++) {
+		if (!jobs.at(i).found)
+			continue;
+		generator->pages++;
+		if (jobs.at(i).page.row >= 0)
+			generator->seeds.insert(jobs.at(i).page.row, jobs.at(i).seed);
+	}
+
+	find_seed_rule(generator);
+	return 0;
+}
+
+int lfsr_seed_for_row(const struct LfsrGenerator &generator, int row, quint32 *seed)
+{
+	quint32 mask = (1ULL << generator.degree) - 1;
+
+	if (!generator.degree || row < 0)
+		return -1;
+
+	switch (generator.seedRule) {
+	case LFSR_SEED_XOR_ROW:
+		*seed = ((quint32)row ^ generator.seedConstant) & mask;
+		break;
+	case LFSR_SEED_ADD_ROW:
+		*seed = ((quint32)row + generator.seedConstant) & mask;
+		break;
+	default:
+		if (!generator.seeds.contains(row))
+			return -1;
+		*seed = generator.seeds.value(row);
+		break;
+	}
+
+	return *seed ? 0 : -1;
+}
+
+void lfsr_keystream(const struct LfsrGenerator &generator, quint32 seed,
+					uint8_t *out, size_t size)
+{
+	generate(generator.poly, seed, generator.msbFirst, out, size);
+}
+
+void lfsr_slice_outputs(int degree, quint32 poly, quint32 base, quint64 *out, int bits)
+{
+	quint64 s[LFSR_DEGREE_MAX];
+	quint64 taps[LFSR_DEGREE_MAX];
+
+	for (int j = 0; j < degree; j++)
+		taps[j] = (poly >> j) & 1 ? ~0ULL : 0;
+	slice_load(degree, base, s);
+	for (int k = 0; k < bits; k++)
+		out[k] = slice_step(degree, taps, s);
+}
@@ -0,0 +1,61 @@
+#ifndef LFSR_H
+#define LFSR_H
+
+#include <QVector>
+#include <QMap>
+#include <QAtomicInt>
+#include "keystream.h"
+
+/* Longest register searched.  Every extra bit quadruples the work. */
+#define LFSR_DEGREE_MAX 20
+
+/* How a page's seed follows from its NAND row */
+enum lfsr_seed_rule {
+	LFSR_SEED_TABLE,        // Only rows seen during the search
+	LFSR_SEED_XOR_ROW,      // row ^ seedConstant
+	LFSR_SEED_ADD_ROW,      // row + seedConstant
+};
+
+/* A Galois LFSR scrambler.  Each step shifts the state right, outputs
+ * the bit that fell off and XORs poly back in if it was set.  Output
+ * bits fill each byte from bit 0, or from bit 7 with msbFirst.  degree
+ * is 0 when there's no generator.
+ */
+struct LfsrGenerator {
+	int degree;
+	quint32 poly;               // Feedback taps, bit degree - 1 always set
+	bool msbFirst;
+	enum lfsr_seed_rule seedRule;
+	quint32 seedConstant;
+	QMap<int, quint32> seeds;   // Row -> seed, from the pages searched
+	int pages;                  // Pages the generator matched
+};
+
+struct lfsr_options {
+	int maxDegree;
+	quint8 plaintext;           // What the pages are assumed to hold
+	const QAtomicInt *cancel;
+};
+
+/* Find the shortest LFSR that explains the first page, then the seed of
+ * every other page under it.  Candidates are run 64 seeds to a word
+ * across all cores.  Returns -1 if nothing matched or the search was
+ * cancelled.
+ */
+int lfsr_search(const QVector<struct keystream_page> &pages,
+				const struct lfsr_options &options, struct LfsrGenerator *generator);
+
+/* The seed for a page from row.  Returns -1 if it isn't known. */
+int lfsr_seed_for_row(const struct LfsrGenerator &generator, int row, quint32 *seed);
+
+/* size bytes of the generator's output from seed */
+void lfsr_keystream(const struct LfsrGenerator &generator, quint32 seed,
+					uint8_t *out, size_t size);
+
+/* bits steps of seeds [base, base + 64) run side by side, as the search
+ * does: bit n of out[k] is output bit k of seed base + n.  For checking
+ * the bit-sliced step against lfsr_keystream().
+ */
+void lfsr_slice_outputs(int degree, quint32 poly, quint32 base, quint64 *out, int bits);
+
+#endif // LFSR_H
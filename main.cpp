@@ -5,6 +5,8 @@
 int main(int argc, char *argv[])
 {
 	QApplication a(argc, argv);
+	a.setOrganizationName("nandsee");
+	a.setApplicationName("nandsee");
 	NandSeeWindow w;
 	w.show();
 	
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include "state.h"
+#include "nand.h"
 
 
 enum control_pins {
@@ -77,3 +78,99 @@ int nand_print(struct state *st, uint8_t data, uint8_t ctrl) {
     return 0;
 }
 
+static uint32_t onfi_le32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* CRC-16 of an ONFI parameter page: polynomial 0x8005, seeded with 0x4f4e */
+static uint16_t onfi_crc16(const uint8_t *p, uint32_t size) {
+    uint16_t crc = 0x4f4e;
+    for (uint32_t i = 0; i < size; i++) {
+        crc ^= p[i] << 8;
+        for (int b = 0; b < 8; b++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x8005 : crc << 1;
+    }
+    return crc;
+}
+
+static int address_bits(uint32_t count) {
+    int bits = 0;
+    while (bits < 32 && (1u << bits) < count)
+        bits++;
+    return bits;
+}
+
+/* Pull the memory organization out of an ONFI parameter page.  The page
+ * is repeated every 256 bytes, so a copy that fails its CRC falls back
+ * to the next.  Returns 0 on success, -1 if there's no intact copy or
+ * it describes something we can't address.
+ */
+int nand_onfi_geometry(const uint8_t *param, uint32_t size, struct nand_geometry *geo) {
+    const uint8_t *copy;
+
+    for (copy = param; copy + 256 <= param + size; copy += 256) {
+        if (memcmp(copy, "ONFI", 4))
+            return -1;
+        if (onfi_crc16(copy, 254) == (copy[254] | (copy[255] << 8)))
+            break;
+    }
+    if (copy + 256 > param + size)
+        return -1;
+
+    geo->page_size = onfi_le32(copy + 80);
+    geo->spare_size = copy[84] | (copy[85] << 8);
+    geo->pages_per_block = onfi_le32(copy + 92);
+    geo->blocks_per_lun = onfi_le32(copy + 96);
+    geo->luns = copy[100];
+
+    if (!geo->page_size || !geo->pages_per_block || !geo->blocks_per_lun || !geo->luns)
+        return -1;
+    if (geo->page_size > NAND_PAGE_BYTES_MAX - geo->spare_size)
+        return -1;
+    if (address_bits(geo->pages_per_block) + address_bits(geo->blocks_per_lun)
+            + address_bits(geo->luns) > 32)
+        return -1;
+    if ((uint64_t)geo->luns * geo->blocks_per_lun * geo->pages_per_block > NAND_PAGES_MAX)
+        return -1;
+    return 0;
+}
+
+uint32_t nand_geometry_pages(const struct nand_geometry *geo) {
+    return geo->luns * geo->blocks_per_lun * geo->pages_per_block;
+}
+
+/* Rows are packed as LUN:block:page, each field as wide as it needs to be.
+ * Split one up, returning -1 if a field is beyond the chip.
+ */
+int nand_row_split(const struct nand_geometry *geo, uint32_t row,
+                   uint32_t *lun, uint32_t *block, uint32_t *page) {
+    int page_bits = address_bits(geo->pages_per_block);
+    int block_bits = address_bits(geo->blocks_per_lun);
+
+    *page = row & ((1u << page_bits) - 1);
+    *block = (row >> page_bits) & ((1u << block_bits) - 1);
+    *lun = row >> (page_bits + block_bits);
+    if (*page >= geo->pages_per_block || *block >= geo->blocks_per_lun || *lun >= geo->luns)
+        return -1;
+    return 0;
+}
+
+/* Turn a row into a linear page number, or -1 if it's beyond the chip */
+int nand_row_page(const struct nand_geometry *geo, uint32_t row, uint32_t *page) {
+    uint32_t lun, block, offset;
+    if (nand_row_split(geo, row, &lun, &block, &offset))
+        return -1;
+    *page = (lun * geo->blocks_per_lun + block) * geo->pages_per_block + offset;
+    return 0;
+}
+
+/* And back again */
+uint32_t nand_page_row(const struct nand_geometry *geo, uint32_t page) {
+    int page_bits = address_bits(geo->pages_per_block);
+    int block_bits = address_bits(geo->blocks_per_lun);
+    uint32_t block = page / geo->pages_per_block;
+
+    return ((block / geo->blocks_per_lun) << (page_bits + block_bits))
+         | ((block % geo->blocks_per_lun) << page_bits)
+         | (page % geo->pages_per_block);
+}
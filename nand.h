@@ -2,6 +2,21 @@
 #define __NAND_H__
 
 #include <stdint.h>
+
+/* Limits on what an ONFI parameter page may claim.  Rows have to fit in
+ * 32 bits, and the heatmap and images are sized per page.
+ */
+#define NAND_PAGES_MAX (1u << 24)
+#define NAND_PAGE_BYTES_MAX (1u << 20)  // Data and spare together
+
+struct nand_geometry {
+    uint32_t page_size;         // Data bytes per page
+    uint32_t spare_size;        // Spare bytes per page
+    uint32_t pages_per_block;
+    uint32_t blocks_per_lun;
+    uint32_t luns;
+};
+
 uint8_t nand_unscramble_byte(uint8_t byte);
 int nand_print(struct state *st, uint8_t data, uint8_t ctrl);
 uint8_t nand_ale(uint8_t ctrl);
@@ -10,5 +25,11 @@ uint8_t nand_we(uint8_t ctrl);
 uint8_t nand_re(uint8_t ctrl);
 uint8_t nand_cs(uint8_t ctrl);
 uint8_t nand_rb(uint8_t ctrl);
+int nand_onfi_geometry(const uint8_t *param, uint32_t size, struct nand_geometry *geo);
+uint32_t nand_geometry_pages(const struct nand_geometry *geo);
+int nand_row_page(const struct nand_geometry *geo, uint32_t row, uint32_t *page);
+int nand_row_split(const struct nand_geometry *geo, uint32_t row,
+                   uint32_t *lun, uint32_t *block, uint32_t *page);
+uint32_t nand_page_row(const struct nand_geometry *geo, uint32_t page);
 
 #endif // __NAND_H__
@@ -0,0 +1,96 @@
+#include <QtConcurrentMap>
+#include "nandheatmap.h"
+#include "bitmap.h"
+
+/* Rows are handed out to cores in ranges of this many */
+#define HEATMAP_RANGE_SIZE 4096
+
+void nand_heatmap_layout(struct NandHeatmap &heatmap, const struct nand_geometry *geo,
+						 const struct RowIndex &index)
+{
+	heatmap.onfi = geo != NULL;
+	if (geo)
+		heatmap.geometry = *geo;
+	else {
+		quint32 highest = index.rows.isEmpty() ? 0 : index.rows.last();
+		memset(&heatmap.geometry, 0, sizeof(heatmap.geometry));
+		heatmap.geometry.pages_per_block = NAND_HEATMAP_DEFAULT_PAGES;
+		heatmap.geometry.blocks_per_lun = qMin(highest / NAND_HEATMAP_DEFAULT_PAGES + 1,
+											   NAND_PAGES_MAX / NAND_HEATMAP_DEFAULT_PAGES);
+		heatmap.geometry.luns = 1;
+	}
+
+	heatmap.cells.resize(nand_geometry_pages(&heatmap.geometry));
+	heatmap.maxCount = 0;
+}
+
+struct heat_range {
+	struct NandHeatmap *heatmap;
+	const struct EventTable *table;
+	const struct RowIndex *index;
+	const QVector<quint64> *visible;
+	int first;
+	int last;
+	quint32 maxCount;
+};
+
+/* Each row is one page, so ranges never write the same cell */
+static void fill_rows(struct heat_range &range)
+{
+	const struct nand_geometry *geo = &range.heatmap->geometry;
+	struct heat_cell *cells = range.heatmap->cells.data();
+	const int *events = range.index->events.constData();
+	const int *starts = range.index->starts.constData();
+
+	range.maxCount = 0;
+	for (int i = range.first; i < range.last; i++) {
+		uint32_t lun, block, page;
+		struct heat_cell cell;
+
+		if (nand_row_split(geo, range.index->rows.at(i), &lun, &block, &page))
+			continue;
+
+		cell.count = 0;
+		cell.last = -1;
+		cell.entropy = 0;
+		for (int j = starts[i]; j < starts[i + 1]; j++) {
+			int event = events[j];
+			if (!bitmap_test(*range.visible, event))
+				continue;
+			cell.count++;
+			cell.last = event;
+			if (range.table->size.at(event))
+				cell.entropy = qBound(0, (int)(range.table->entropy.at(event) * 32), 255);
+		}
+
+		cells[(lun * geo->blocks_per_lun + block) * geo->pages_per_block + page] = cell;
+		range.maxCount = qMax(range.maxCount, cell.count);
+	}
+}
+
+void nand_heatmap_fill(struct NandHeatmap &heatmap, const struct EventTable &table,
+					   const struct RowIndex &index, const QVector<quint64> &visible)
+{
+	QVector<struct heat_range> ranges;
+	int first;
+
+	memset(heatmap.cells.data(), 0, heatmap.cells.count() * sizeof(struct heat_cell));
+	for (int i = 0; i < heatmap.cells.count(); i++)
+		heatmap.cells[i].last = -1;
+
+	for (first = 0; first < index.rows.count(); first += HEATMAP_RANGE_SIZE) {
+		struct heat_range range;
+		range.heatmap = &heatmap;
+		range.table = &table;
+		range.index = &index;
+		range.visible = &visible;
+		range.first = first;
+		range.last = qMin(first + HEATMAP_RANGE_SIZE, index.rows.count());
+		ranges.append(range);
+	}
+	QtConcurrent::blockingMap(ranges, fill_rows);
+
+	heatmap.maxCount = 0;
+	for (int i = 0; i < ranges.count(); i++)
+		heatmap.maxCount = qMax(heatmap.maxCount, ranges.at(i).maxCount);
+}
@@ -0,0 +1,38 @@
+#ifndef NANDHEATMAP_H
+#define NANDHEATMAP_H
+
+#include <QVector>
+#include "eventtable.h"
+#include "rowindex.h"
+#include "nand.h"
+
+/* Pages per block assumed when the capture has no ONFI parameter page */
+#define NAND_HEATMAP_DEFAULT_PAGES 64
+
+/* What's been done to one page by the events that are showing */
+struct heat_cell {
+	quint32 count;              // Accesses
+	qint32 last;                // Last access, -1 if none
+	quint8 entropy;             // Of the last access with data, 1/32 bits per byte
+};
+
+/* Every page of the chip, block by block */
+struct NandHeatmap {
+	struct nand_geometry geometry;
+	bool onfi;                  // Geometry came from a parameter page
+	QVector<struct heat_cell> cells;
+	quint32 maxCount;
+};
+
+/* Lay out the chip.  Without ONFI geometry, a single LUN is assumed, with
+ * NAND_HEATMAP_DEFAULT_PAGES pages per block and enough blocks for the
+ * highest row accessed, up to NAND_PAGES_MAX pages.
+ */
+void nand_heatmap_layout(struct NandHeatmap &heatmap, const struct nand_geometry *geo,
+						 const struct RowIndex &index);
+
+/* Count accesses by events set in visible, one row range per core */
+void nand_heatmap_fill(struct NandHeatmap &heatmap, const struct EventTable &table,
+					   const struct RowIndex &index, const QVector<quint64> &visible);
+
+#endif // NANDHEATMAP_H
@@ -0,0 +1,193 @@
+#include <QDebug>
+#include <QtConcurrentRun>
+#include "nandimage.h"
+#include "byteswap.h"
+
+NandImageBuilder::NandImageBuilder(const EventStream *events, QObject *parent) :
+	QObject(parent),
+	_events(events),
+	_allVersions(false),
+	_haveGeometry(false),
+	_failed(false),
+	_stride(NAND_IMAGE_DEFAULT_STRIDE),
+	_next(0)
+{
+	memset(&_geometry, 0, sizeof(_geometry));
+	connect(&_watcher, SIGNAL(finished()), this, SLOT(gotBatchFinished()));
+}
+
+NandImageBuilder::~NandImageBuilder()
+{
+	_worker.waitForFinished();
+	close();
+}
+
+static bool is_page_event(int type)
+{
+	return type == EVT_NAND_READ
+		|| type == EVT_NAND_CHANGE_READ_COLUMN
+		|| type == EVT_NAND_DATA;
+}
+
+/* Lay pages out the way the chip says it's organized.  Failing that,
+ * give each row as much room as the largest page seen so far.
+ */
+void NandImageBuilder::findGeometry()
+{
+	const struct EventTable &table = _events->table();
+	int count = _events->loadedCount();
+	uint32_t largest = 0;
+	int i;
+
+	_haveGeometry = !_events->nandGeometry(&_geometry);
+	if (_haveGeometry) {
+		_stride = _geometry.page_size + _geometry.spare_size;
+		return;
+	}
+
+	for (i = 0; i < count; i++)
+		if (is_page_event(table.type.at(i)))
+			largest = qMax(largest, table.size.at(i));
+
+	_stride = NAND_IMAGE_DEFAULT_STRIDE;
+	if (largest)
+		for (_stride = 1; _stride < largest; _stride <<= 1)
+			;
+	qDebug() << "No ONFI parameter page, using a page stride of" << _stride;
+}
+
+int NandImageBuilder::start(const QString &fileName, bool allVersions)
+{
+	if (isRunning()) {
+		qDebug() << "A NAND image is already being built";
+		return -1;
+	}
+
+	findGeometry();
+	if (_image.open(fileName, _stride))
+		return -1;
+
+	_failed = false;
+	_allVersions = allVersions;
+	if (_allVersions) {
+		_versions.setFileName(fileName + ".versions");
+		if (!_versions.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+			qDebug() << "Couldn't open versions file:" << _versions.errorString();
+			_image.close();
+			return -1;
+		}
+	}
+
+	_next = 0;
+	update();
+	return 0;
+}
+
+bool NandImageBuilder::isRunning() const
+{
+	return _image.isOpen();
+}
+
+const struct nand_geometry *NandImageBuilder::geometry() const
+{
+	return _haveGeometry ? &_geometry : NULL;
+}
+
+/* Runs on a worker thread, over events that have finished loading */
+void NandImageBuilder::process(int first, int last)
+{
+	const struct EventTable &table = _events->table();
+	int i;
+
+	for (i = first; i < last; i++) {
+		const uint8_t *data;
+		uint32_t size;
+		qint64 page;
+		qint32 row = table.row.at(i);
+		qint32 column = table.column.at(i);
+
+		if (!is_page_event(table.type.at(i)) || row < 0)
+			continue;
+
+		size = _events->eventPayload(i, &data);
+		if (!size)
+			continue;
+
+		if (_haveGeometry) {
+			uint32_t chipPage;
+			if (nand_row_page(&_geometry, row, &chipPage)) {
+				qDebug() << "Event" << i << "row" << row << "lies outside the chip";
+				continue;
+			}
+			page = chipPage;
+		}
+		else
+			page = row;
+
+		// Don't let an oversized read spill into the next page
+		if (column >= _stride)
+			continue;
+		size = qMin((qint64)size, _stride - column);
+
+		if (_image.write(page * _stride + column, (const char *)data, size)) {
+			_failed = true;
+			return;
+		}
+
+		if (_allVersions) {
+			uint32_t header[4];
+			header[0] = _htonl(row);
+			header[1] = _htonl(column);
+			header[2] = _htonl(i);
+			header[3] = _htonl(size);
+			if (_versions.write((const char *)header, sizeof(header)) != sizeof(header)
+			 || _versions.write((const char *)data, size) != size) {
+				qDebug() << "Couldn't write versions file:" << _versions.errorString();
+				_failed = true;
+				return;
+			}
+		}
+	}
+}
+
+/* Start on whatever has loaded since the last batch.  Called as events
+ * load, and again as each batch finishes.
+ */
+void NandImageBuilder::update()
+{
+	if (!isRunning() || _worker.isRunning())
+		return;
+
+	if (_failed) {
+		close();
+		emit failed();
+		return;
+	}
+
+	int available = _events->loadedCount();
+	if (_next < available) {
+		_worker = QtConcurrent::run(this, &NandImageBuilder::process, _next, available);
+		_watcher.setFuture(_worker);
+		_next = available;
+		return;
+	}
+
+	if (!_events->isLoading() && _next >= _events->totalCount()) {
+		qint64 pages = _image.coveredUnits();
+		close();
+		emit finished(pages);
+	}
+}
+
+void NandImageBuilder::gotBatchFinished()
+{
+	emit progress(_next, _image.coveredUnits());
+	update();
+}
+
+void NandImageBuilder::close()
+{
+	_image.close();
+	if (_versions.isOpen())
+		_versions.close();
+}
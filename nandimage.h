@@ -0,0 +1,67 @@
+#ifndef NANDIMAGE_H
+#define NANDIMAGE_H
+
+#include <QObject>
+#include <QFile>
+#include <QFuture>
+#include <QFutureWatcher>
+#include "eventstream.h"
+#include "sparseimage.h"
+#include "nand.h"
+
+/* Page stride used when the capture has no ONFI parameter page and no
+ * page reads have loaded yet.
+ */
+#define NAND_IMAGE_DEFAULT_STRIDE 16384
+
+/* Rebuilds the chip contents from every page read or written in an
+ * event stream.  Each page lands at its row's place in a sparse image,
+ * later accesses overwriting earlier ones.  With allVersions set, every
+ * access is also appended to <image>.versions as a big-endian
+ * (row, column, event index, size) header followed by the data.
+ *
+ * Events are processed on a worker thread as they finish loading.  The
+ * image is closed, and finished() emitted, once the whole stream is in,
+ * or failed() emitted as soon as a write goes wrong.
+ */
+class NandImageBuilder : public QObject
+{
+	Q_OBJECT
+public:
+	explicit NandImageBuilder(const EventStream *events, QObject *parent = 0);
+	~NandImageBuilder();
+
+	int start(const QString &fileName, bool allVersions);
+	bool isRunning() const;
+	const struct nand_geometry *geometry() const;
+
+signals:
+	void progress(int events, qint64 pages);
+	void finished(qint64 pages);
+	void failed();
+
+public slots:
+	void update();
+
+private slots:
+	void gotBatchFinished();
+
+private:
+	const EventStream *_events;
+	SparseImage _image;
+	QFile _versions;
+	bool _allVersions;
+	bool _haveGeometry;
+	bool _failed;               // Set by the worker when a write fails
+	struct nand_geometry _geometry;
+	qint64 _stride;
+	int _next;
+	QFuture<void> _worker;
+	QFutureWatcher<void> _watcher;
+
+	void findGeometry();
+	void process(int first, int last);
+	void close();
+};
+
+#endif // NANDIMAGE_H
@@ -13,9 +13,14 @@ TEMPLATE = app
 SOURCES += main.cpp\
         nandseewindow.cpp \
     nandview.cpp \
+    timeline.cpp \
+    nandheatmap.cpp \
+    heatmapview.cpp \
     eventstream.cpp \
     event.cpp \
     eventitemmodel.cpp \
+    eventitemdelegate.cpp \
+    eventsort.cpp \
     qhexedit.cpp \
     qhexedit_p.cpp \
     xbytearray.cpp \
@@ -28,14 +33,34 @@ SOURCES += main.cpp\
     grouper.cpp \
     sorter.cpp \
     byteswap.cpp \
-    histogramview.cpp
+    histogramview.cpp \
+    eventmetrics.cpp \
+    entropy.cpp \
+    xorbytes.cpp \
+    xoralign.cpp \
+    keystream.cpp \
+    lfsr.cpp \
+    autocorr.cpp \
+    autocorrview.cpp \
+    bitmap.cpp \
+    eventtable.cpp \
+    eventfilter.cpp \
+    rowindex.cpp \
+    sparseimage.cpp \
+    nandimage.cpp \
+    sdimage.cpp
 
 HEADERS  += nandseewindow.h \
     nandview.h \
+    timeline.h \
+    nandheatmap.h \
+    heatmapview.h \
     eventstream.h \
     event.h \
     event-struct.h \
     eventitemmodel.h \
+    eventitemdelegate.h \
+    eventsort.h \
     qhexedit.h \
     qhexedit_p.h \
     xbytearray.h \
@@ -47,7 +72,22 @@ HEADERS  += nandseewindow.h \
     tapboardprocessorprivate.h \
     byteswap.h \
     nand.h \
-    histogramview.h
+    histogramview.h \
+    eventmetrics.h \
+    entropy.h \
+    xorbytes.h \
+    xoralign.h \
+    keystream.h \
+    lfsr.h \
+    autocorr.h \
+    autocorrview.h \
+    bitmap.h \
+    eventtable.h \
+    eventfilter.h \
+    rowindex.h \
+    sparseimage.h \
+    nandimage.h \
+    sdimage.h
 
 FORMS    += nandseewindow.ui \
     hexwindow.ui
@@ -5,22 +5,45 @@
 #include <QString>
 #include <QCoreApplication>
 #include <QScrollBar>
+#include <QListWidget>
+#include <QtAlgorithms>
 #include <QGraphicsEllipseItem>
 #include <QGraphicsLineItem>
+#include <QSettings>
+#include <QInputDialog>
+#include <QLabel>
+#include <QtConcurrentRun>
 #include "histogramview.h"
 
 #include "nandseewindow.h"
 #include "eventitemmodel.h"
+#include "eventitemdelegate.h"
+#include "eventsort.h"
 #include "hexwindow.h"
 #include "ui_nandseewindow.h"
 #include "tapboardprocessor.h"
 #include "nand.h"
+#include "nandimage.h"
+#include "sdimage.h"
+#include "xorbytes.h"
+#include "keystream.h"
+#include "lfsr.h"
+#include "entropy.h"
 
 #define _USE_MATH_DEFINES
 #include <math.h>
 
 #define PI M_PI
 
+/* Accesses listed for the current row.  Previous/Next still walk all of them. */
+#define ROW_ACCESS_LIST_MAX 1000
+
+/* Rows either side of a selection to decode along with it */
+#define SELECTION_PREFETCH_NEIGHBOURS 16
+
+// Longest keystream repeat offered, in rows
+#define KEYSTREAM_PERIOD_MAX 65536
+
 #define	Z_MAX          6.0            /* maximum meaningful z value */
 #define	LOG_SQRT_PI     0.5723649429247000870717135 /* log (sqrt (pi)) */
 #define	I_SQRT_PI       0.5641895835477562869480795 /* 1 / sqrt (pi) */
@@ -57,6 +80,8 @@ NandSeeWindow::NandSeeWindow(QWidget *parent) :
     }
 
 	_eventItemModel = new EventItemModel(this);
+	QSettings settings;
+	_eventItemModel->setCacheBudget(settings.value("eventCacheMB", EVENT_CACHE_DEFAULT_MB).toInt());
 	if (_eventItemModel->loadFile(fileName)) {
 		qDebug() << "Couldn't load file";
 		exit(0);
@@ -64,8 +89,13 @@ NandSeeWindow::NandSeeWindow(QWidget *parent) :
 	_eventItemSelections = new QItemSelectionModel(_eventItemModel);
 	ui->eventList->setModel(_eventItemModel);
 	ui->eventList->setSelectionModel(_eventItemSelections);
+	ui->eventList->setItemDelegate(new EventItemDelegate(ui->eventList));
+	ui->eventList->sortByColumn(EVENT_COLUMN_INDEX, Qt::AscendingOrder);
+	ui->eventList->setSortingEnabled(true);
 
 	ui->histogramView->setStatsOutput(ui->histogramValues);
+	ui->timelineView->setModel(_eventItemModel);
+	ui->heatmapView->setModel(_eventItemModel);
 
     this->setWindowTitle("nandsee - " + fileName);
 
@@ -75,6 +105,33 @@ NandSeeWindow::NandSeeWindow(QWidget *parent) :
 	connect(_eventItemSelections, SIGNAL(currentChanged(QModelIndex,QModelIndex)),
 			this, SLOT(changeLastSelected(QModelIndex,QModelIndex)));
 
+	connect(ui->previousRowAccess, SIGNAL(clicked()),
+			this, SLOT(previousRowAccess()));
+	connect(ui->nextRowAccess, SIGNAL(clicked()),
+			this, SLOT(nextRowAccess()));
+	connect(ui->rowAccessList, SIGNAL(itemActivated(QListWidgetItem*)),
+			this, SLOT(rowAccessActivated(QListWidgetItem*)));
+
+	connect(ui->timelineView, SIGNAL(eventClicked(int)),
+			this, SLOT(selectEvent(int)));
+	connect(ui->heatmapView, SIGNAL(eventClicked(int)),
+			this, SLOT(selectEvent(int)));
+	connect(ui->heatmapMode, SIGNAL(currentIndexChanged(int)),
+			ui->heatmapView, SLOT(setColourMode(int)));
+	connect(ui->histogramMode, SIGNAL(currentIndexChanged(int)),
+			ui->histogramView, SLOT(setMode(int)));
+	connect(ui->autocorrView, SIGNAL(lagClicked(int)),
+			ui->lastAlignOffset, SLOT(setValue(int)));
+	connect(ui->autocorrPeriods, SIGNAL(itemActivated(QListWidgetItem*)),
+			this, SLOT(autocorrPeriodActivated(QListWidgetItem*)));
+
+	connect(ui->eventFilter, SIGNAL(textChanged(QString)),
+			this, SLOT(filterChanged(QString)));
+
+	connect(_eventItemModel, SIGNAL(loadFinished()),
+			this, SLOT(loadFinished()));
+	ui->statusBar->showMessage("Loading events...");
+
 	connect(ui->eventList, SIGNAL(doubleClicked(QModelIndex)),
 			this, SLOT(openHexWindow(QModelIndex)));
 
@@ -90,6 +147,41 @@ NandSeeWindow::NandSeeWindow(QWidget *parent) :
 			this, SLOT(exportCurrentView()));
 	connect(ui->exportPageMenuItem, SIGNAL(triggered()),
 			this, SLOT(exportCurrentPage()));
+	connect(ui->exportNandImageMenuItem, SIGNAL(triggered()),
+			this, SLOT(exportNandImage()));
+	connect(ui->exportNandVersionsMenuItem, SIGNAL(triggered()),
+			this, SLOT(exportNandVersions()));
+
+	_nandImage = new NandImageBuilder(&_eventItemModel->events(), this);
+	connect(_eventItemModel, SIGNAL(eventsAvailable()),
+			_nandImage, SLOT(update()));
+	connect(_eventItemModel, SIGNAL(loadFinished()),
+			_nandImage, SLOT(update()));
+	connect(_nandImage, SIGNAL(progress(int,qint64)),
+			this, SLOT(nandImageProgress(int,qint64)));
+	connect(_nandImage, SIGNAL(finished(qint64)),
+			this, SLOT(nandImageFinished(qint64)));
+	connect(_nandImage, SIGNAL(failed()),
+			this, SLOT(nandImageFailed()));
+
+	connect(ui->exportSdImageMenuItem, SIGNAL(triggered()),
+			this, SLOT(exportSdImage()));
+	_sdImage = new SdImageBuilder(&_eventItemModel->events(), this);
+	connect(_eventItemModel, SIGNAL(eventsAvailable()),
+			_sdImage, SLOT(update()));
+	connect(_eventItemModel, SIGNAL(loadFinished()),
+			_sdImage, SLOT(update()));
+	connect(_sdImage, SIGNAL(progress(int,qint64)),
+			this, SLOT(sdImageProgress(int,qint64)));
+	connect(_sdImage, SIGNAL(finished(qint64)),
+			this, SLOT(sdImageFinished(qint64)));
+	connect(_sdImage, SIGNAL(failed()),
+			this, SLOT(sdImageFailed()));
+
+	connect(ui->cacheBudgetMenuItem, SIGNAL(triggered()),
+			this, SLOT(setCacheBudget()));
+	_cacheStats = new QLabel(this);
+	ui->statusBar->addPermanentWidget(_cacheStats);
 
     connect(ui->actionHighlightMatches, SIGNAL(toggled(bool)),
             ui->hexView, SLOT(setHighlightSame(bool)));
@@ -99,6 +191,18 @@ NandSeeWindow::NandSeeWindow(QWidget *parent) :
 
     connect(ui->optimizeXor, SIGNAL(clicked()),
             this, SLOT(optimizeXor()));
+	connect(&_alignWatcher, SIGNAL(finished()),
+			this, SLOT(alignSearchFinished()));
+	connect(ui->actionRecoverKeystream, SIGNAL(triggered()),
+			this, SLOT(recoverKeystream()));
+	connect(ui->actionClearKeystream, SIGNAL(triggered()),
+			this, SLOT(clearKeystream()));
+	connect(&_keystreamWatcher, SIGNAL(finished()),
+			this, SLOT(keystreamRecovered()));
+	connect(ui->actionFindLfsr, SIGNAL(triggered()),
+			this, SLOT(findLfsr()));
+	connect(&_lfsrWatcher, SIGNAL(finished()),
+			this, SLOT(lfsrFound()));
 	connect(ui->actionInvertBeforeXor, SIGNAL(triggered(bool)),
 			this, SLOT(invertBeforeXor(bool)));
 
@@ -109,23 +213,43 @@ NandSeeWindow::NandSeeWindow(QWidget *parent) :
 
     totalc = 0; // required init by entropy module
     lastAlignAt = 0;
+	_lfsr.degree = 0;
 }
 
 NandSeeWindow::~NandSeeWindow()
 {
+	_alignCancel = 1;
+	_alignWatcher.waitForFinished();
+	_keystreamWatcher.waitForFinished();
+	_lfsrCancel = 1;
+	_lfsrWatcher.waitForFinished();
+
+	// Their workers read from the model's event stream
+	delete _nandImage;
+	delete _sdImage;
 	delete ui;
 }
 
 void NandSeeWindow::eventSelectionChanged(const QItemSelection &selected, const QItemSelection &deselected)
 {
-	Q_UNUSED(selected);
 	Q_UNUSED(deselected);
+
+	// Analyses walk the whole selection, so decode it in one go
+	for (int i=0; i<selected.count(); i++) {
+		const QItemSelectionRange &range = selected.at(i);
+		_eventItemModel->prefetch(range.top() - SELECTION_PREFETCH_NEIGHBOURS,
+				range.height() + 2 * SELECTION_PREFETCH_NEIGHBOURS);
+	}
 	updateHexView();
+	updateCacheStats();
 }
 
 void NandSeeWindow::updateEventDetails()
 {
-	Event e = _eventItemModel->eventAt(mostRecent.row());
+	if (!mostRecent.isValid())
+		return;
+
+	const Event &e = _eventItemModel->eventAt(mostRecent.row());
 
 	QString temp;
 	ui->startTimeLabel->setText(QString("%1.%2").arg(e.secondsStart()).arg(e.nanoSecondsStart(), 9, 10, QLatin1Char('0')));
@@ -165,9 +289,10 @@ void NandSeeWindow::updateEventDetails()
 	ui->eventTypeLabel->setText(temp);
 
 	ui->entropyLabel->setText(QString::number(e.entropy()));
-	ui->indexLabel->setText(QString::number(mostRecent.row()));
+	ui->indexLabel->setText(QString::number(_eventItemModel->eventIndex(mostRecent.row())));
 
 	hideLabels();
+	updateRowAccesses(e.index());
 
 	if (e.eventType() == EVT_NAND_ID) {
 		ui->attributeLine->setVisible(true);
@@ -324,47 +449,138 @@ void NandSeeWindow::updateAlign(int value)
     updateHexView();
 }
 
+/* Bring _xorStack in line with the current selection.  Only events that
+ * joined or left since last time are touched, so extending a selection
+ * of a thousand pages by one costs one payload.
+ */
+void NandSeeWindow::updateXorStack()
+{
+	const QModelIndexList indexes = _eventItemSelections->selectedRows();
+	QVector<int> wanted;
+	int i;
+
+	wanted.reserve(indexes.count());
+	for (i=0; i<indexes.count(); i++)
+		wanted.append(_eventItemModel->eventIndex(indexes.at(i).row()));
+	qSort(wanted);
+
+	// Both sides are sorted; walk them together
+	QMap<int, int>::iterator it = _xorEvents.begin();
+	i = 0;
+	while (it != _xorEvents.end() || i < wanted.count()) {
+		if (it == _xorEvents.end() || (i < wanted.count() && wanted.at(i) < it.key())) {
+			foldXorEvent(wanted.at(i++), true);
+		}
+		else if (i == wanted.count() || it.key() < wanted.at(i)) {
+			int event = it.key();
+			++it;
+			foldXorEvent(event, false);
+		}
+		else {
+			++it;
+			i++;
+		}
+	}
+
+	// Bytes past the longest payload left have cancelled back to zero
+	int length = _xorLengths.isEmpty() ? 0 : (_xorLengths.end() - 1).key();
+	if (_xorStack.size() > length)
+		_xorStack.truncate(length);
+}
+
+void NandSeeWindow::foldXorEvent(int event, bool add)
+{
+	const uint8_t *data;
+	int size;
+
+	if (add) {
+		size = _eventItemModel->events().eventPayload(event, &data);
+		if (size > _xorStack.size())
+			_xorStack.append(QByteArray(size - _xorStack.size(), 0));
+		_xorEvents.insert(event, size);
+		_xorLengths[size]++;
+	}
+	else {
+		size = _xorEvents.take(event);
+		_eventItemModel->events().eventPayload(event, &data);
+		if (--_xorLengths[size] == 0)
+			_xorLengths.remove(size);
+	}
+
+	if (data && size)
+		xor_bytes((uint8_t *)_xorStack.data(), data, size);
+
+	// Descramble on the way in; the keystream cancels the same way going out
+	const QByteArray *keystream = keystream_for_row(_keystream,
+			_eventItemModel->table().row.at(event));
+	if (keystream && size)
+		xor_bytes((uint8_t *)_xorStack.data(), (const uint8_t *)keystream->constData(),
+				qMin(size, keystream->size()));
+
+	quint32 seed;
+	if (size && !lfsr_seed_for_row(_lfsr, _eventItemModel->table().row.at(event), &seed)) {
+		QByteArray generated(size, 0);
+		lfsr_keystream(_lfsr, seed, (uint8_t *)generated.data(), size);
+		xor_bytes((uint8_t *)_xorStack.data(), (const uint8_t *)generated.constData(), size);
+	}
+}
+
+/* Forget what's been folded in, so the next update starts over */
+void NandSeeWindow::resetXorStack()
+{
+	_xorStack.clear();
+	_xorEvents.clear();
+	_xorLengths.clear();
+}
+
+/* Inverting every event but the first before XORing them is the same as
+ * XORing them raw and flipping each byte covered by an odd number of the
+ * inverted ones.  Coverage only changes at payload lengths, so that's a
+ * handful of spans rather than a pass per event.  The first event is the
+ * earliest one selected.
+ */
+void NandSeeWindow::applyXorInversion()
+{
+	uint8_t *data = (uint8_t *)currentData.data();
+	int first = _xorEvents.begin().value();
+	int covering = 0;
+
+	QMap<int, int>::const_iterator it = _xorLengths.constEnd();
+	while (it != _xorLengths.constBegin()) {
+		--it;
+		covering += it.value();
+		int start = it == _xorLengths.constBegin() ? 0 : (it - 1).key();
+		int end = it.key();
+
+		// [start, end) is covered by 'covering' events, one of which is
+		// the first below its own length
+		int split = qBound(start, first, end);
+		if ((covering - 1) & 1)
+			xor_invert(data + start, split - start);
+		if (covering & 1)
+			xor_invert(data + split, end - split);
+	}
+}
+
 void NandSeeWindow::updateHexView()
 {
-	if (mostRecent.row() < 0)
+	if (!mostRecent.isValid())
 		return;
-	Event e = _eventItemModel->eventAt(mostRecent.row());
-	const QModelIndexList indexes = _eventItemSelections->selectedIndexes();
 
     ui->lastAlignOffset->setValue(lastAlignAt);
 	// Xor the data in the hex output
-	currentData = 0;
-	for (int i=0; i<indexes.count(); i++) {
-		Event e = _eventItemModel->eventAt(indexes.at(i).row());
-		const QByteArray currentArray = e.data();
-		char *data = currentData.data();
-		int position;
-
-		// Resize the current data backing if necessary
-		if (currentArray.size() > currentData.size()) {
-			int oldSize = currentData.size();
-			currentData.resize(currentArray.size());
-			data = currentData.data();
-			for (position=oldSize; position<currentArray.size(); position++)
-				currentData[position] = 0;
-		}
-
-		// Xor the current data field onto the standing data backing
-		for (position=0; position<currentData.size() && position<currentArray.size(); position++) {
-			if (_invertBeforeXor && i>0)
-				data[position] ^= ~currentArray.at(position);
-			else
-				data[position] ^= currentArray.at(position);
-		}
-	}
+	updateXorStack();
+	currentData = _xorStack;
+	currentData.detach();
+	if (_invertBeforeXor && !_xorEvents.isEmpty())
+		applyXorInversion();
+	_xorBase = currentData;
 
 	// Xor in the pattern, too
-	if (_xorPattern.size() > 0) {
-		char *data = currentData.data();
-        for (int i=0; i<currentData.size() - lastAlignAt; i++) {
-			data[i + lastAlignAt] ^= _xorPattern.at(i%_xorPattern.size());
-		}
-	}
+	if (_xorPattern.size() > 0 && currentData.size() > lastAlignAt)
+		xor_pattern((uint8_t *)currentData.data() + lastAlignAt,
+				currentData.size() - lastAlignAt,
+				(const uint8_t *)_xorPattern.constData(), _xorPattern.size());
     ui->hexView->setData(currentData);
 
 	if (currentData.size())
@@ -372,15 +588,13 @@ void NandSeeWindow::updateHexView()
 	else
         ui->dataSizeLabel->setText("-");
 
-    ui->histogramView->setData(currentData);
-
-    // update entropy window
-    this->initEntropy();
-    for(int i = 0; i < currentData.size(); i++) {
-        unsigned char c = currentData[i];
-        this->updateEntropy(&c, 1);
-    }
-    this->finalizeEntropy();
+    // One pass over the data feeds both the histogram and the entropy window
+    struct byte_stats stats;
+    byte_stats((const uint8_t *)currentData.constData(), currentData.size(), &stats);
+    ui->histogramView->setData(currentData, stats);
+	ui->autocorrView->setData(currentData);
+	updateAutocorrPeriods();
+    this->finalizeEntropy(stats);
 
     QString entropyStr = QString("Entropy = %1 bits/byte\n").arg(this->r_ent);
     entropyStr += QString("mean = %1\n").arg(this->r_mean);
@@ -401,6 +615,28 @@ void NandSeeWindow::updateHexView()
    
 }
 
+/* List the repeat periods found in the hex view, strongest first */
+void NandSeeWindow::updateAutocorrPeriods()
+{
+	const QVector<struct autocorr_peak> &peaks = ui->autocorrView->peaks();
+
+	ui->autocorrPeriods->clear();
+	for (int i=0; i<peaks.count(); i++) {
+		QListWidgetItem *item = new QListWidgetItem(QString("Every %1 bytes (r = %2)")
+				.arg(peaks.at(i).lag).arg(peaks.at(i).value, 0, 'f', 2));
+		item->setData(Qt::UserRole, peaks.at(i).lag);
+		ui->autocorrPeriods->addItem(item);
+	}
+}
+
+void NandSeeWindow::autocorrPeriodActivated(QListWidgetItem *item)
+{
+	int period = item->data(Qt::UserRole).toInt();
+
+	ui->statusBar->showMessage(QString("Repeats every %1 bytes: try a %1-byte Xor pattern").arg(period), 10000);
+	ui->lastAlignOffset->setValue(period);
+}
+
 void NandSeeWindow::hideLabels()
 {
 	ui->attributeLine->setVisible(false);
@@ -417,88 +653,29 @@ void NandSeeWindow::changeLastSelected(const QModelIndex &index, const QModelInd
 	Q_UNUSED(old);
 	mostRecent = index;
 	updateEventDetails();
+	if (index.isValid())
+		ui->timelineView->setCurrentEvent(_eventItemModel->eventIndex(index.row()));
     ui->ignoreEventsAction->setEnabled(true);
 }
 
-void NandSeeWindow::initEntropy()
+void NandSeeWindow::finalizeEntropy(const struct byte_stats &stats)
 {
-    /* Initialise for calculations */
     int i;
+    double prob;
 
     ent = 0.0;		       /* Clear entropy accumulator */
     chisq = 0.0;	       /* Clear Chi-Square */
     datasum = 0.0;	       /* Clear sum of bytes for arithmetic mean */
+    totalc = stats.total;
 
-    mp = 0;		       /* Reset Monte Carlo accumulator pointer */
-    mcount = 0; 	       /* Clear Monte Carlo tries */
-    inmont = 0; 	       /* Clear Monte Carlo inside count */
-    incirc = 65535.0 * 65535.0;/* In-circle distance for Monte Carlo */
-
-    sccfirst = 1;	       /* Mark first time for serial correlation */
-    scct1 = scct2 = scct3 = 0.0; /* Clear serial correlation terms */
-
-    incirc = pow(pow(256.0, (double) (MONTEN / 2)) - 1, 2.0);
+    /* Complete calculation of serial correlation coefficient.  The
+       sums of bytes and of their squares fall out of the histogram. */
 
+    double scct1 = stats.serial, scct2 = 0.0, scct3 = 0.0;
     for (i = 0; i < 256; i++) {
-        ccount[i] = 0;
+        scct2 += (double) i * stats.hist[i];
+        scct3 += (double) i * i * stats.hist[i];
     }
-    totalc = 0;
-}
-
-void NandSeeWindow::updateEntropy(unsigned char *buf, int bufl)
-{
-    unsigned char bp = 0;
-    unsigned char oc, c;
-
-    while (bufl-- > 0) {
-        oc = (buf[bp++] & 0xFF);
-        c =   oc;
-        ccount[c]++;		  /* Update counter for this bin */
-        totalc++;
-
-        /* Update inside / outside circle counts for Monte Carlo
-         computation of PI */
-
-        monte[mp++] = (double) oc;       /* Save character for Monte Carlo */
-        if (mp >= MONTEN) {     /* Calculate every MONTEN character */
-            int mj;
-
-            mp = 0;
-            mcount++;
-            montex = montey = 0;
-            for (mj = 0; mj < MONTEN / 2; mj++) {
-                montex = (montex * 256.0) + monte[mj];
-                montey = (montey * 256.0) + monte[(MONTEN / 2) + mj];
-            }
-            if ((montex * montex + montey *  montey) <= incirc) {
-                inmont++;
-            }
-        }
-
-        /* Update calculation of serial correlation coefficient */
-
-        sccun = (double) c;
-        if (sccfirst) {
-            sccfirst = 0;
-            scclast = 0;
-            sccu0 = sccun;
-        } else {
-            scct1 = scct1 + scclast * sccun;
-        }
-        scct2 = scct2 + sccun;
-        scct3 = scct3 + (sccun * sccun);
-        scclast = sccun;
-        oc <<= 1;
-    }
-}
-
-void NandSeeWindow::finalizeEntropy()
-{
-    int i;
-
-    /* Complete calculation of serial correlation coefficient */
-
-    scct1 = scct1 + scclast * sccu0;
     scct2 = scct2 * scct2;
     scc = totalc * scct3 - scct2;
     if (scc == 0.0) {
@@ -508,32 +685,29 @@ void NandSeeWindow::finalizeEntropy()
     }
 
     /* Scan bins and calculate probability for each bin and
-       Chi-Square distribution.  The probability will be reused
-       in the entropy calculation below.  While we're at it,
+       Chi-Square distribution.  The probability also feeds the
+       entropy.  While we're at it,
        we sum of all the data which will be used to compute the
        mean. */
 
     cexp = totalc / 256.0;  /* Expected count per bin */
     for (i = 0; i < 256; i++) {
-       double a = ccount[i] - cexp;;
+       double a = stats.hist[i] - cexp;
 
-       prob[i] = ((double) ccount[i]) / totalc;
+       prob = ((double) stats.hist[i]) / totalc;
        chisq += (a * a) / cexp;
-       datasum += ((double) i) * ccount[i];
-    }
+       datasum += ((double) i) * stats.hist[i];
 
-    /* Calculate entropy */
-
-    for (i = 0; i < 256; i++) {
-       if (prob[i] > 0.0) {
-            ent += prob[i] * log2of10 * log10(1 / prob[i]);
+       /* Calculate entropy */
+       if (prob > 0.0) {
+            ent += prob * log2of10 * log10(1 / prob);
        }
     }
 
     /* Calculate Monte Carlo value for PI from percentage of hits
        within the circle */
 
-    montepi = 4.0 * (((double) inmont) / mcount);
+    montepi = 4.0 * (((double) stats.monte_hits) / stats.monte_tries);
 
     /* Return results through arguments */
 
@@ -684,24 +858,221 @@ void NandSeeWindow::invertBeforeXor(bool state)
 	updateHexView();
 }
 
+struct keystream_page NandSeeWindow::samplePage(int event) const
+{
+	struct keystream_page page;
+	page.size = _eventItemModel->events().eventPayload(event, &page.data);
+	page.row = _eventItemModel->table().row.at(event);
+	return page;
+}
+
+/* NAND data pages to learn a scrambler from: the selected ones, or every
+ * visible one if fewer than two are selected.
+ */
+QVector<struct keystream_page> NandSeeWindow::samplePages() const
+{
+	const struct EventTable &table = _eventItemModel->table();
+	const QModelIndexList indexes = _eventItemSelections->selectedRows();
+	QVector<struct keystream_page> pages;
+	int i;
+
+	for (i=0; i<indexes.count(); i++) {
+		int event = _eventItemModel->eventIndex(indexes.at(i).row());
+		if (table.type.at(event) == EVT_NAND_DATA)
+			pages.append(samplePage(event));
+	}
+
+	if (pages.count() < 2) {
+		const QVector<int> &visible = _eventItemModel->events().currentEvents();
+		pages.clear();
+		for (i=0; i<visible.count(); i++) {
+			if (table.type.at(visible.at(i)) == EVT_NAND_DATA)
+				pages.append(samplePage(visible.at(i)));
+		}
+	}
+
+	return pages;
+}
+
+/* What the sample pages should hold once descrambled.  Returns -1 if the
+ * user backs out.
+ */
+int NandSeeWindow::askPlaintext(const QString &title, quint8 *plaintext)
+{
+	QStringList plaintexts;
+	bool ok;
+
+	plaintexts << "00 (zero-filled)" << "ff (erased)";
+	QString choice = QInputDialog::getItem(this, title,
+			"Most of these pages hold:", plaintexts, 1, false, &ok);
+	if (!ok)
+		return -1;
+
+	*plaintext = choice == plaintexts.at(0) ? 0x00 : 0xff;
+	return 0;
+}
+
+/* Learn the scrambler keystream from pages that should be blank */
+void NandSeeWindow::recoverKeystream()
+{
+	QVector<struct keystream_page> pages = samplePages();
+	quint8 plaintext;
+	bool ok;
+
+	if (pages.count() < 2) {
+		ui->statusBar->showMessage("Need at least two NAND data pages to recover a keystream", 5000);
+		return;
+	}
+
+	int period = QInputDialog::getInt(this, "Recover keystream",
+			QString("Keystream repeats every N rows (%1 pages):").arg(pages.count()),
+			1, 1, KEYSTREAM_PERIOD_MAX, 1, &ok);
+	if (!ok)
+		return;
+
+	if (askPlaintext("Recover keystream", &plaintext))
+		return;
+
+	ui->actionRecoverKeystream->setEnabled(false);
+	ui->statusBar->showMessage(QString("Recovering keystream from %1 pages...").arg(pages.count()));
+	_keystreamWatcher.setFuture(QtConcurrent::run(keystream_recover,
+			pages, period, plaintext, &_keystreamResult));
+}
+
+/* Brute-force an LFSR that generates the sample pages' keystream.  A
+ * second trigger while it runs calls it off.
+ */
+void NandSeeWindow::findLfsr()
+{
+	if (_lfsrWatcher.isRunning()) {
+		_lfsrCancel = 1;
+		return;
+	}
+
+	QVector<struct keystream_page> pages = samplePages();
+	struct lfsr_options options;
+	bool ok;
+
+	if (pages.isEmpty()) {
+		ui->statusBar->showMessage("Need a NAND data page to search for an LFSR", 5000);
+		return;
+	}
+
+	options.maxDegree = QInputDialog::getInt(this, "Find LFSR scrambler",
+			QString("Longest register to try, in bits (%1 pages):").arg(pages.count()),
+			16, 2, LFSR_DEGREE_MAX, 1, &ok);
+	if (!ok)
+		return;
+
+	if (askPlaintext("Find LFSR scrambler", &options.plaintext))
+		return;
+
+	_lfsrCancel = 0;
+	options.cancel = &_lfsrCancel;
+	ui->actionFindLfsr->setText("Cancel LFSR search");
+	ui->statusBar->showMessage(QString("Searching LFSRs up to %1 bits...").arg(options.maxDegree));
+	_lfsrWatcher.setFuture(QtConcurrent::run(lfsr_search,
+			pages, options, &_lfsrResult));
+}
+
+void NandSeeWindow::lfsrFound()
+{
+	ui->actionFindLfsr->setText(QString::fromUtf8("Find LFSR scrambler…"));
+
+	if (_lfsrWatcher.result() < 0) {
+		ui->statusBar->showMessage(_lfsrCancel ? "LFSR search cancelled"
+				: "No LFSR matched the first page", 5000);
+		return;
+	}
+
+	_lfsr = _lfsrResult;
+	resetXorStack();
+	updateHexView();
+	ui->actionClearKeystream->setEnabled(true);
+
+	QString seeds = QString("seeds for %1 rows").arg(_lfsr.seeds.count());
+	if (_lfsr.seedRule == LFSR_SEED_XOR_ROW)
+		seeds = QString("seed row ^ 0x%1").arg(_lfsr.seedConstant, 0, 16);
+	else if (_lfsr.seedRule == LFSR_SEED_ADD_ROW)
+		seeds = QString("seed row + 0x%1").arg(_lfsr.seedConstant, 0, 16);
+
+	ui->statusBar->showMessage(QString("LFSR found: %1 bits, taps 0x%2, %3 first, %4, matched %5 pages")
+			.arg(_lfsr.degree).arg(_lfsr.poly, 0, 16)
+			.arg(_lfsr.msbFirst ? "msb" : "lsb")
+			.arg(seeds).arg(_lfsr.pages), 10000);
+}
+
+void NandSeeWindow::keystreamRecovered()
+{
+	ui->actionRecoverKeystream->setEnabled(true);
+
+	if (_keystreamWatcher.result() < 0) {
+		ui->statusBar->showMessage("No pages to recover a keystream from", 5000);
+		return;
+	}
+
+	_keystream = _keystreamResult;
+	resetXorStack();
+	updateHexView();
+	ui->actionClearKeystream->setEnabled(true);
+
+	double agreement = _keystream.total ? 100.0 * _keystream.agreeing / _keystream.total : 0.0;
+	ui->statusBar->showMessage(QString("Keystream recovered, period %1: most common byte is %2% of page bytes")
+			.arg(_keystream.period).arg(agreement, 0, 'f', 1), 10000);
+}
+
+void NandSeeWindow::clearKeystream()
+{
+	_keystream = Keystream();
+	_lfsr = LfsrGenerator();
+	resetXorStack();
+	updateHexView();
+	ui->actionClearKeystream->setEnabled(false);
+}
+
+/* Look for the pattern alignment that leaves the data least random.
+ * Every shift up to the end of the data is scored on a worker; clicking
+ * again while it runs calls it off.
+ */
 void NandSeeWindow::optimizeXor()
 {
-    double maxchisq = this->r_chisq;
-    lastAlignAt = 0;
-    int bestAlign = 0;
-    QString hexChars = "00";
-    for(int i=0;i<256;i++) {
-        lastAlignAt = i;
-        updateHexView(); // call this to update stats
-        if( this->r_chisq > maxchisq ) {
-            maxchisq = this->r_chisq;
-            bestAlign = i;
-        }
-//        this->update();
-        qApp->processEvents(QEventLoop::ExcludeSocketNotifiers);
-    }
-    lastAlignAt = bestAlign;
-    updateHexView();
+	if (_alignWatcher.isRunning()) {
+		_alignCancel = 1;
+		return;
+	}
+
+	if (_xorPattern.isEmpty() || _xorBase.isEmpty()) {
+		ui->statusBar->showMessage("Select some data and enter an Xor pattern to align", 5000);
+		return;
+	}
+
+	_alignCancel = 0;
+	_alignBase = _xorBase;
+	_alignPattern = _xorPattern;
+	ui->optimizeXor->setText("Cancel");
+	ui->statusBar->showMessage(QString("Trying %1 Xor alignments...").arg(_alignBase.size() + 1));
+	_alignWatcher.setFuture(QtConcurrent::run(xor_align_search, _alignBase, _alignPattern,
+			_alignBase.size() + 1, (const QAtomicInt *)&_alignCancel, &_alignResult));
+}
+
+void NandSeeWindow::alignSearchFinished()
+{
+	ui->optimizeXor->setText("Optimize Xor");
+
+	if (_alignWatcher.result() < 0) {
+		ui->statusBar->showMessage("Xor alignment search cancelled", 5000);
+		return;
+	}
+
+	// The selection or pattern may have moved on while it ran
+	if (_alignBase != _xorBase || _alignPattern != _xorPattern) {
+		ui->statusBar->showMessage("Data changed during the Xor alignment search", 5000);
+		return;
+	}
+
+	ui->statusBar->showMessage(QString("Best Xor alignment: %1 inserts, chisq %2")
+			.arg(_alignResult.shift).arg(_alignResult.chisq), 10000);
+	ui->lastAlignOffset->setValue(_alignResult.shift);
 }
 
 void NandSeeWindow::xorPatternChanged(const QString &text)
@@ -730,12 +1101,15 @@ void NandSeeWindow::xorPatternChanged(const QString &text)
 
 void NandSeeWindow::exportCurrentPage()
 {
+	if (!mostRecent.isValid())
+		return;
+
 	QString suggestedName;
 	QFileDialog selectFile(ui->centralWidget);
 	selectFile.setFileMode(QFileDialog::AnyFile);
 	selectFile.setAcceptMode(QFileDialog::AcceptSave);
 	selectFile.setNameFilter("Page dump (*.bin)");
-	suggestedName.sprintf("page-%d.bin", mostRecent.row());
+	suggestedName.sprintf("page-%d.bin", _eventItemModel->eventIndex(mostRecent.row()));
 	selectFile.selectFile(suggestedName);
 	selectFile.selectNameFilter("bin");
 	if (!selectFile.exec()) {
@@ -753,20 +1127,142 @@ void NandSeeWindow::exportCurrentPage()
 		return;
 	}
 
-	Event e = _eventItemModel->eventAt(mostRecent.row());
+	const Event &e = _eventItemModel->eventAt(mostRecent.row());
 	saveFile.write(e.data());
 	saveFile.close();
 	return;
 }
 
+void NandSeeWindow::exportNandImage()
+{
+	startNandImage(false);
+}
+
+void NandSeeWindow::exportNandVersions()
+{
+	startNandImage(true);
+}
+
+void NandSeeWindow::startNandImage(bool allVersions)
+{
+	QFileDialog selectFile(ui->centralWidget);
+	selectFile.setFileMode(QFileDialog::AnyFile);
+	selectFile.setAcceptMode(QFileDialog::AcceptSave);
+	selectFile.setNameFilter("NAND image (*.bin)");
+	selectFile.selectFile("nand.bin");
+	selectFile.selectNameFilter("bin");
+	if (!selectFile.exec()) {
+		qDebug() << "No file selected";
+		return;
+	}
+
+	if (_nandImage->start(selectFile.selectedFiles()[0], allVersions)) {
+		ui->statusBar->showMessage("Couldn't start NAND image", 5000);
+		return;
+	}
+	ui->exportNandImageMenuItem->setEnabled(false);
+	ui->exportNandVersionsMenuItem->setEnabled(false);
+}
+
+void NandSeeWindow::nandImageProgress(int events, qint64 pages)
+{
+	ui->statusBar->showMessage(QString("Building NAND image: %1 events, %2 pages").arg(events).arg(pages));
+}
+
+void NandSeeWindow::nandImageFinished(qint64 pages)
+{
+	const struct nand_geometry *geo = _nandImage->geometry();
+	QString message = QString("NAND image finished: %1 pages").arg(pages);
+	if (geo)
+		message += QString(" of %1").arg(nand_geometry_pages(geo));
+	ui->statusBar->showMessage(message, 10000);
+	ui->exportNandImageMenuItem->setEnabled(true);
+	ui->exportNandVersionsMenuItem->setEnabled(true);
+}
+
+void NandSeeWindow::nandImageFailed()
+{
+	ui->statusBar->showMessage("Couldn't write NAND image", 10000);
+	ui->exportNandImageMenuItem->setEnabled(true);
+	ui->exportNandVersionsMenuItem->setEnabled(true);
+}
+
+void NandSeeWindow::exportSdImage()
+{
+	QFileDialog selectFile(ui->centralWidget);
+	selectFile.setFileMode(QFileDialog::AnyFile);
+	selectFile.setAcceptMode(QFileDialog::AcceptSave);
+	selectFile.setNameFilter("SD card image (*.img)");
+	selectFile.selectFile("sdcard.img");
+	selectFile.selectNameFilter("img");
+	if (!selectFile.exec()) {
+		qDebug() << "No file selected";
+		return;
+	}
+
+	if (_sdImage->start(selectFile.selectedFiles()[0])) {
+		ui->statusBar->showMessage("Couldn't start SD card image", 5000);
+		return;
+	}
+	ui->exportSdImageMenuItem->setEnabled(false);
+}
+
+void NandSeeWindow::sdImageProgress(int events, qint64 sectors)
+{
+	ui->statusBar->showMessage(QString("Building SD card image: %1 events, %2 sectors").arg(events).arg(sectors));
+}
+
+void NandSeeWindow::sdImageFinished(qint64 sectors)
+{
+	ui->statusBar->showMessage(QString("SD card image finished: %1 sectors").arg(sectors), 10000);
+	ui->exportSdImageMenuItem->setEnabled(true);
+}
+
+void NandSeeWindow::sdImageFailed()
+{
+	ui->statusBar->showMessage("Couldn't write SD card image", 10000);
+	ui->exportSdImageMenuItem->setEnabled(true);
+}
+
+void NandSeeWindow::setCacheBudget()
+{
+	bool ok;
+	int megabytes = QInputDialog::getInt(this, "Event cache",
+			"Memory for decoded events (MB):",
+			_eventItemModel->events().cacheBudget(),
+			1, EVENT_CACHE_MAX_MB, 1, &ok);
+	if (!ok)
+		return;
+
+	_eventItemModel->setCacheBudget(megabytes);
+	QSettings settings;
+	settings.setValue("eventCacheMB", megabytes);
+	updateCacheStats();
+}
+
+void NandSeeWindow::updateCacheStats()
+{
+	const EventStream &events = _eventItemModel->events();
+	quint64 hits = events.cacheHits();
+	quint64 total = hits + events.cacheMisses();
+	_cacheStats->setText(QString("Cache: %1 hits, %2 misses (%3%), %4 MB")
+			.arg(hits)
+			.arg(total - hits)
+			.arg(total ? 100 * hits / total : 0)
+			.arg(events.cacheBudget()));
+}
+
 void NandSeeWindow::exportCurrentView()
 {
+	if (!mostRecent.isValid())
+		return;
+
 	QString suggestedName;
 	QFileDialog selectFile(ui->centralWidget);
 	selectFile.setFileMode(QFileDialog::AnyFile);
 	selectFile.setAcceptMode(QFileDialog::AcceptSave);
 	selectFile.setNameFilter("Page dump (*.bin)");
-	suggestedName.sprintf("view-%d.bin", mostRecent.row());
+	suggestedName.sprintf("view-%d.bin", _eventItemModel->eventIndex(mostRecent.row()));
 	selectFile.selectFile(suggestedName);
 	selectFile.selectNameFilter("bin");
 	if (!selectFile.exec()) {
@@ -792,7 +1288,7 @@ void NandSeeWindow::exportCurrentView()
 
 void NandSeeWindow::openHexWindow(const QModelIndex &index)
 {
-	Event e = _eventItemModel->eventAt(index.row());
+	const Event &e = _eventItemModel->eventAt(index.row());
 	HexWindow *newWindow;
 	QString newWindowTitle = QString("Showing %1 @ %2").arg(e.eventTypeStr()).arg(QString::number(index.row()));
 	newWindow = new HexWindow(this);
@@ -811,14 +1307,114 @@ void NandSeeWindow::closeHexWindow(HexWindow *closingWindow)
 
 void NandSeeWindow::ignoreEvents()
 {
+    if (!mostRecent.isValid())
+        return;
     _eventItemModel->ignoreEventsOfType(_eventItemModel->eventAt(mostRecent.row()).eventType());
-    ui->eventList->reset();
     ui->unignoreEventsAction->setEnabled(true);
 }
 
 void NandSeeWindow::unignoreEvents()
 {
     _eventItemModel->resetIgnoredEvents();
-    ui->eventList->reset();
     ui->ignoreEventsAction->setEnabled(false);
 }
+
+void NandSeeWindow::loadFinished()
+{
+    ui->statusBar->showMessage(QString("Loaded %1 events").arg(_eventItemModel->rowCount()), 5000);
+    updateCacheStats();
+
+    // The row index wasn't ready for whatever was picked during loading
+    if (mostRecent.isValid())
+        updateRowAccesses(_eventItemModel->eventIndex(mostRecent.row()));
+}
+
+void NandSeeWindow::filterChanged(const QString &text)
+{
+    if (_eventItemModel->setFilter(text)) {
+        ui->eventFilter->setStyleSheet("color: red");
+        ui->statusBar->showMessage(_eventItemModel->filterError());
+        return;
+    }
+    ui->eventFilter->setStyleSheet("");
+    ui->statusBar->clearMessage();
+}
+
+/* List every other event that touched the same NAND row as event
+ * current.  Stays empty until the file has finished loading.
+ */
+void NandSeeWindow::updateRowAccesses(int current)
+{
+	const struct EventTable &table = _eventItemModel->table();
+	int i;
+
+	ui->rowAccessList->clear();
+	_rowAccesses.clear();
+	if (table.row.at(current) >= 0)
+		_rowAccesses = _eventItemModel->eventsForRow(table.row.at(current));
+
+	ui->rowAccessLabel->setText(QString("Row accesses: %1").arg(_rowAccesses.count()));
+	ui->previousRowAccess->setEnabled(!_rowAccesses.isEmpty() && _rowAccesses.first() < current);
+	ui->nextRowAccess->setEnabled(!_rowAccesses.isEmpty() && _rowAccesses.last() > current);
+
+	for (i = 0; i < _rowAccesses.count() && i < ROW_ACCESS_LIST_MAX; i++) {
+		int index = _rowAccesses.at(i);
+		QString type = EventTypes().value(table.type.at(index));
+		type.remove(0, 4);
+
+		QListWidgetItem *item = new QListWidgetItem(QString("#%1  %2.%3  %4  col %5")
+				.arg(index)
+				.arg(table.start.at(index) / 1000000000)
+				.arg(table.start.at(index) % 1000000000, 9, 10, QLatin1Char('0'))
+				.arg(type)
+				.arg(table.column.at(index)));
+		item->setData(Qt::UserRole, index);
+		ui->rowAccessList->addItem(item);
+		if (index == current)
+			ui->rowAccessList->setCurrentItem(item);
+	}
+	if (_rowAccesses.count() > ROW_ACCESS_LIST_MAX)
+		ui->rowAccessList->addItem(QString("... %1 more").arg(_rowAccesses.count() - ROW_ACCESS_LIST_MAX));
+}
+
+/* Make event index the current selection, if the filters let it be seen */
+void NandSeeWindow::selectEvent(int index)
+{
+	int row = _eventItemModel->rowForEvent(index);
+	if (row < 0) {
+		ui->statusBar->showMessage(QString("Event #%1 is hidden by the current filter").arg(index), 5000);
+		return;
+	}
+
+	QModelIndex modelIndex = _eventItemModel->index(row, 0, QModelIndex());
+	_eventItemSelections->setCurrentIndex(modelIndex,
+			QItemSelectionModel::ClearAndSelect | QItemSelectionModel::Rows);
+	ui->eventList->scrollTo(modelIndex);
+}
+
+void NandSeeWindow::previousRowAccess()
+{
+	if (!mostRecent.isValid())
+		return;
+	int current = _eventItemModel->eventIndex(mostRecent.row());
+	QVector<int>::const_iterator it = qLowerBound(_rowAccesses.constBegin(), _rowAccesses.constEnd(), current);
+	if (it != _rowAccesses.constBegin())
+		selectEvent(*(it - 1));
+}
+
+void NandSeeWindow::nextRowAccess()
+{
+	if (!mostRecent.isValid())
+		return;
+	int current = _eventItemModel->eventIndex(mostRecent.row());
+	QVector<int>::const_iterator it = qUpperBound(_rowAccesses.constBegin(), _rowAccesses.constEnd(), current);
+	if (it != _rowAccesses.constEnd())
+		selectEvent(*it);
+}
+
+void NandSeeWindow::rowAccessActivated(QListWidgetItem *item)
+{
+	QVariant index = item->data(Qt::UserRole);
+	if (index.isValid())
+		selectEvent(index.toInt());
+}
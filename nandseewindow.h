@@ -3,20 +3,29 @@
 
 #include <QMainWindow>
 #include <QModelIndex>
+#include <QPersistentModelIndex>
 #include <QItemSelectionModel>
+#include <QVector>
+#include <QMap>
+#include <QFutureWatcher>
+#include <QAtomicInt>
+#include "xoralign.h"
+#include "keystream.h"
+#include "lfsr.h"
 
 #define log2of10 3.32192809488736234787
-#define MONTEN	6		      /* Bytes used as Monte Carlo
-                     co-ordinates.	This should be no more
-                     bits than the mantissa of your
-                                         "double" floating point type. */
-
 
 namespace Ui {
 class NandSeeWindow;
 }
 
 class EventItemModel;
+class NandImageBuilder;
+class SdImageBuilder;
+class Event;
+class QListWidgetItem;
+class QLabel;
+struct byte_stats;
 
 class HexWindow;
 class NandSeeWindow : public QMainWindow
@@ -34,13 +43,38 @@ public slots:
 
 	void xorPatternChanged(const QString &text);
 	void optimizeXor();
+	void alignSearchFinished();
+	void recoverKeystream();
+	void keystreamRecovered();
+	void clearKeystream();
+	void findLfsr();
+	void lfsrFound();
+	void autocorrPeriodActivated(QListWidgetItem *item);
 
 	void exportCurrentView();
 	void exportCurrentPage();
+	void exportNandImage();
+	void exportNandVersions();
+	void nandImageProgress(int events, qint64 pages);
+	void nandImageFinished(qint64 pages);
+	void nandImageFailed();
+	void exportSdImage();
+	void sdImageProgress(int events, qint64 sectors);
+	void sdImageFinished(qint64 sectors);
+	void sdImageFailed();
+	void setCacheBudget();
 
     void ignoreEvents();
     void unignoreEvents();
 
+    void loadFinished();
+    void filterChanged(const QString &text);
+
+    void previousRowAccess();
+    void nextRowAccess();
+    void rowAccessActivated(QListWidgetItem *item);
+    void selectEvent(int index);
+
     void closeHexWindow(HexWindow *closingWindow);
 
     void updateAlign(int value);
@@ -51,33 +85,63 @@ private:
 	Ui::NandSeeWindow *ui;
 	EventItemModel *_eventItemModel;
 	QItemSelectionModel *_eventItemSelections;
+	NandImageBuilder *_nandImage;
+	SdImageBuilder *_sdImage;
+	QLabel *_cacheStats;
 	QByteArray currentData;
-	QModelIndex mostRecent;
+	QPersistentModelIndex mostRecent;   // Follows its event through sorts and filters
 	QByteArray _xorPattern;
     int _xorPatternSkip;
     int lastAlignAt;
 	bool _invertBeforeXor;
 
-    long ccount[256],	   /* Bins to count occurrences of values */
-            totalc; 	   /* Total bytes counted */
-    double prob[256];	   /* Probabilities per bin for entropy */
-
-
-    int mp, sccfirst;
-    unsigned int monte[MONTEN];
-    long inmont, mcount;
-    double cexp, incirc, montex, montey, montepi,
-              scc, sccun, sccu0, scclast, scct1, scct2, scct3,
-              ent, chisq, datasum;
+	/* Running XOR of the selected payloads.  Events are folded in and
+	 * out as the selection changes rather than re-XORing it all.
+	 */
+	QByteArray _xorStack;
+	QMap<int, int> _xorEvents;      // Event index -> payload length
+	QMap<int, int> _xorLengths;     // Payload length -> events of that length
+	QByteArray _xorBase;            // currentData before the pattern goes on
+
+	/* Alignment search, run against a snapshot of the base and pattern */
+	QFutureWatcher<int> _alignWatcher;
+	QAtomicInt _alignCancel;
+	QByteArray _alignBase;
+	QByteArray _alignPattern;
+	struct xor_align_result _alignResult;
+
+	/* Keystream taken off each page before it's folded in */
+	struct Keystream _keystream;
+	QFutureWatcher<int> _keystreamWatcher;
+	struct Keystream _keystreamResult;
+
+	/* LFSR scrambler, generated per page from its row's seed */
+	struct LfsrGenerator _lfsr;
+	QFutureWatcher<int> _lfsrWatcher;
+	QAtomicInt _lfsrCancel;
+	struct LfsrGenerator _lfsrResult;
+	QVector<int> _rowAccesses;
+
+    long totalc; 	   /* Total bytes counted */
+    double cexp, montepi, scc, ent, chisq, datasum;
 
     double r_ent, r_chisq, r_mean, r_montepicalc, r_scc, r_chip;
 
 	void updateEventDetails();
+	void updateRowAccesses(int current);
+	void startNandImage(bool allVersions);
+	void updateCacheStats();
+	void updateXorStack();
+	void foldXorEvent(int event, bool add);
+	void resetXorStack();
+	struct keystream_page samplePage(int event) const;
+	QVector<struct keystream_page> samplePages() const;
+	int askPlaintext(const QString &title, quint8 *plaintext);
+	void applyXorInversion();
 	void updateHexView();
+	void updateAutocorrPeriods();
 	void hideLabels();
-    void initEntropy();
-    void updateEntropy(unsigned char *buf, int bufl);
-    void finalizeEntropy();
+    void finalizeEntropy(const struct byte_stats &stats);
     double poz(double z);
     double pochisq(double ax, int df);
 };
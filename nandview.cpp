@@ -1,15 +1,62 @@
-#include <QDebug>
 #include <QPainter>
 #include <QScrollBar>
+#include <QKeyEvent>
+#include <QWheelEvent>
+#include <QMouseEvent>
+#include <QtConcurrentRun>
+#include <math.h>
 #include "nandview.h"
+#include "eventitemmodel.h"
 
 NandView::NandView(QWidget *parent) :
-	QAbstractScrollArea(parent)
+	QAbstractScrollArea(parent),
+	_model(NULL),
+	_ready(false),
+	_viewStart(0),
+	_nsPerPixel(1),
+	_currentEvent(-1)
 {
+	for (int i = 0; i < TIMELINE_SHADES; i++)
+		_shades[i] = QColor::fromHsvF(.6, .25 + .75 * i / (TIMELINE_SHADES - 1), .9 - .4 * i / (TIMELINE_SHADES - 1));
+	connect(&_builderWatcher, SIGNAL(finished()), this, SLOT(gotTimelineBuilt()));
+	setFocusPolicy(Qt::StrongFocus);
 }
 
 NandView::~NandView()
 {
+	_builder.waitForFinished();
+}
+
+//------------------------------------------------------------------------------
+// Name: setModel
+// Desc: the timeline is built once the model's file has finished loading
+//------------------------------------------------------------------------------
+void NandView::setModel(EventItemModel *model) {
+	_model = model;
+	connect(_model, SIGNAL(loadFinished()), this, SLOT(buildTimeline()));
+}
+
+//------------------------------------------------------------------------------
+// Name: buildTimeline
+//------------------------------------------------------------------------------
+void NandView::buildTimeline() {
+	if (!_model || _builder.isRunning())
+		return;
+	_ready = false;
+	_builder = QtConcurrent::run(this, &NandView::build);
+	_builderWatcher.setFuture(_builder);
+	viewport()->update();
+}
+
+// Runs on a worker thread
+void NandView::build() {
+	timeline_build(_timeline, _model->table(), _model->table().count());
+}
+
+void NandView::gotTimelineBuilt() {
+	_ready = true;
+	_columns.lanes.clear();
+	zoomAll();
 }
 
 //------------------------------------------------------------------------------
@@ -20,13 +67,104 @@ void NandView::repaint() {
 		viewport()->repaint();
 }
 
+//------------------------------------------------------------------------------
+// Name: setCurrentEvent
+// Desc: marks the event selected elsewhere
+//------------------------------------------------------------------------------
+void NandView::setCurrentEvent(int index) {
+	_currentEvent = index;
+	viewport()->update();
+}
+
+qint64 NandView::span() const {
+	return qMax((qint64)1, _timeline.end - _timeline.start);
+}
+
+int NandView::columns() const {
+	return qMax(1, viewport()->width() - TIMELINE_LABEL_WIDTH);
+}
+
+// Scrollbars count in pixels until the capture is too long for an int
+double NandView::scrollUnit() const {
+	return qMax(_nsPerPixel, span() / 1073741824.0);
+}
+
+//------------------------------------------------------------------------------
+// Name: zoomAll
+//------------------------------------------------------------------------------
+void NandView::zoomAll() {
+	_viewStart = 0;
+	_nsPerPixel = qMax(TIMELINE_MIN_NS_PER_PIXEL, (double)span() / columns());
+	updateScrollbars();
+	viewport()->update();
+}
+
+//------------------------------------------------------------------------------
+// Name: zoom
+// Desc: zooms by factor, keeping the time under column x in place
+//------------------------------------------------------------------------------
+void NandView::zoom(double factor, int x) {
+	double maxNsPerPixel = qMax(TIMELINE_MIN_NS_PER_PIXEL, (double)span() / columns());
+	qint64 anchor = _viewStart + (qint64)(x * _nsPerPixel);
+
+	_nsPerPixel = qBound(TIMELINE_MIN_NS_PER_PIXEL, _nsPerPixel * factor, maxNsPerPixel);
+	_viewStart = anchor - (qint64)(x * _nsPerPixel);
+	_viewStart = qBound((qint64)0, _viewStart, qMax((qint64)0, span() - (qint64)(columns() * _nsPerPixel)));
+	updateScrollbars();
+	viewport()->update();
+}
 
 //------------------------------------------------------------------------------
 // Name: keyPressEvent
-// Desc:
 //------------------------------------------------------------------------------
 void NandView::keyPressEvent(QKeyEvent *event) {
-	qDebug() << "Key pressed:" << event;
+	switch (event->key()) {
+	case Qt::Key_Plus:
+	case Qt::Key_Equal:
+		zoom(0.5, columns() / 2);
+		break;
+	case Qt::Key_Minus:
+		zoom(2, columns() / 2);
+		break;
+	case Qt::Key_Home:
+		zoomAll();
+		break;
+	default:
+		QAbstractScrollArea::keyPressEvent(event);
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: wheelEvent
+// Desc: the wheel zooms around the pointer
+//------------------------------------------------------------------------------
+void NandView::wheelEvent(QWheelEvent *event) {
+	if (!_ready || event->orientation() != Qt::Vertical) {
+		QAbstractScrollArea::wheelEvent(event);
+		return;
+	}
+	zoom(pow(2.0, -event->delta() / 240.0), qMax(0, event->x() - TIMELINE_LABEL_WIDTH));
+	event->accept();
+}
+
+//------------------------------------------------------------------------------
+// Name: mousePressEvent
+// Desc: clicking near an event selects it
+//------------------------------------------------------------------------------
+void NandView::mousePressEvent(QMouseEvent *event) {
+	if (!_ready || event->x() < TIMELINE_LABEL_WIDTH || event->y() < TIMELINE_AXIS_HEIGHT)
+		return;
+
+	int lane = (event->y() - TIMELINE_AXIS_HEIGHT) / TIMELINE_LANE_HEIGHT
+			 + verticalScrollBar()->value();
+	if (lane >= _timeline.types.count())
+		return;
+
+	qint64 time = _viewStart + (qint64)((event->x() - TIMELINE_LABEL_WIDTH) * _nsPerPixel);
+	int index = timeline_find(_timeline, _model->table(), lane, time,
+							  qMax((qint64)1, (qint64)(3 * _nsPerPixel)));
+	if (index >= 0)
+		emit eventClicked(index);
 }
 
 //------------------------------------------------------------------------------
@@ -36,44 +174,104 @@ void NandView::resizeEvent(QResizeEvent *) {
 		updateScrollbars();
 }
 
+void NandView::scrollContentsBy(int dx, int dy) {
+	Q_UNUSED(dx);
+	Q_UNUSED(dy);
+	_viewStart = (qint64)(horizontalScrollBar()->value() * scrollUnit());
+	viewport()->update();
+}
+
 
 //------------------------------------------------------------------------------
 // Name: paintEvent
+// Desc: one line per lane per pixel column, whatever the zoom
 //------------------------------------------------------------------------------
 void NandView::paintEvent(QPaintEvent *) {
 	QPainter painter(viewport());
-	int font_width_ = 12;
-	int chars_per_row = 8;
-	int origin_ = 0;
-	painter.translate(-horizontalScrollBar()->value() * font_width_, 0);
-
-	// current actual offset (in bytes)
-	quint64 offset = (quint64)verticalScrollBar()->value() * chars_per_row;
-
-	if(origin_ != 0) {
-			if(offset > 0) {
-					offset += origin_;
-					offset -= chars_per_row;
-			} else {
-					origin_ = 0;
-					updateScrollbars();
-			}
+	int width = columns();
+	int lane, x;
+
+	painter.fillRect(viewport()->rect(), palette().base());
+	if (!_ready) {
+		painter.drawText(viewport()->rect(), Qt::AlignCenter,
+						 _model ? "Building timeline..." : "");
+		return;
+	}
+
+	// Axis: the times at either edge of the view
+	painter.setPen(palette().text().color());
+	painter.drawText(TIMELINE_LABEL_WIDTH, 0, width, TIMELINE_AXIS_HEIGHT,
+					 Qt::AlignLeft | Qt::AlignVCenter,
+					 QString("%1 s").arg((_timeline.start + _viewStart) / 1e9, 0, 'f', 9));
+	painter.drawText(TIMELINE_LABEL_WIDTH, 0, width, TIMELINE_AXIS_HEIGHT,
+					 Qt::AlignRight | Qt::AlignVCenter,
+					 QString("%1 ns/pixel").arg(_nsPerPixel, 0, 'g', 4));
+
+	// Unsorted captures only have the pyramid to go on
+	if (!_timeline.sorted && _nsPerPixel < ((qint64)1 << _timeline.shift))
+		painter.drawText(TIMELINE_LABEL_WIDTH, 0, width, TIMELINE_AXIS_HEIGHT,
+						 Qt::AlignHCenter | Qt::AlignVCenter,
+						 QString("Events out of time order, no detail below %1 ns")
+						 .arg((qint64)1 << _timeline.shift));
+
+	timeline_columns(_timeline, _model->table(), _viewStart, _nsPerPixel, width, _columns);
+
+	for (lane = verticalScrollBar()->value(); lane < _timeline.types.count(); lane++) {
+		int top = TIMELINE_AXIS_HEIGHT
+				+ (lane - verticalScrollBar()->value()) * TIMELINE_LANE_HEIGHT;
+		int bottom = top + TIMELINE_LANE_HEIGHT - 2;
+		if (top >= viewport()->height())
+			break;
+
+		painter.setPen(palette().text().color());
+		painter.drawText(2, top, TIMELINE_LABEL_WIDTH - 4, TIMELINE_LANE_HEIGHT,
+						 Qt::AlignLeft | Qt::AlignVCenter,
+						 EventTypes().value(_timeline.types.at(lane)).mid(4));
+
+		const QVector<struct timeline_bin> &bins = _columns.lanes.at(lane);
+		for (x = 0; x < width; x++) {
+			const struct timeline_bin &bin = bins.at(x);
+			if (!bin.count)
+				continue;
+
+			// Entropy runs up the lane, with at least a short tick to show
+			int shade = 0;
+			for (quint32 count = bin.count; count > 1 && shade < TIMELINE_SHADES - 1; count >>= 1)
+				shade++;
+			int y0 = bottom - bin.min * (TIMELINE_LANE_HEIGHT - 2) / 256;
+			int y1 = qMin(bottom - 3, bottom - bin.max * (TIMELINE_LANE_HEIGHT - 2) / 256);
+			painter.setPen(_shades[shade]);
+			painter.drawLine(TIMELINE_LABEL_WIDTH + x, y0, TIMELINE_LABEL_WIDTH + x, y1);
+		}
+	}
+
+	if (_currentEvent >= 0 && _currentEvent < _model->table().count()) {
+		x = (int)((_model->table().start.at(_currentEvent) - _timeline.start - _viewStart) / _nsPerPixel);
+		if (x >= 0 && x < width) {
+			painter.setPen(Qt::red);
+			painter.drawLine(TIMELINE_LABEL_WIDTH + x, TIMELINE_AXIS_HEIGHT,
+							 TIMELINE_LABEL_WIDTH + x, viewport()->height());
+		}
 	}
 }
 
 //------------------------------------------------------------------------------
 // Name: updateScrollbars
-// Desc: recalculates scrollbar maximum value base on number of NAND blocks
+// Desc: horizontal scrolling covers the capture at the current zoom, vertical
+//       scrolling steps through lanes
 //------------------------------------------------------------------------------
 void NandView::updateScrollbars() {
-	/*
-	const qint64 sz = dataSize();
-	const int bpr = bytesPerRow();
-
-	qint64 maxval = sz / bpr + ((sz % bpr) ? 1 : 0) - viewport()->height() / font_height_;
-	static_cast<int>((line3() - viewport()->width()) / font_width_)));
-	*/
-	qint64 maxval = 200;
-	verticalScrollBar()->setMaximum(qMax((qint64)0, maxval));
-	horizontalScrollBar()->setMaximum(qMax(0, 500));
+	double unit = scrollUnit();
+	qint64 visible = (qint64)(columns() * _nsPerPixel);
+	int lanes = (viewport()->height() - TIMELINE_AXIS_HEIGHT) / TIMELINE_LANE_HEIGHT;
+
+	horizontalScrollBar()->blockSignals(true);
+	horizontalScrollBar()->setRange(0, (int)(qMax((qint64)0, span() - visible) / unit));
+	horizontalScrollBar()->setPageStep(qMax(1, (int)(visible / unit)));
+	horizontalScrollBar()->setSingleStep(qMax(1, (int)(visible / unit / 10)));
+	horizontalScrollBar()->setValue((int)(_viewStart / unit));
+	horizontalScrollBar()->blockSignals(false);
+
+	verticalScrollBar()->setRange(0, qMax(0, _timeline.types.count() - lanes));
+	verticalScrollBar()->setPageStep(qMax(1, lanes));
 }
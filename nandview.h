@@ -2,8 +2,30 @@
 #define NANDVIEW_H
 
 #include <QAbstractScrollArea>
+#include <QFuture>
+#include <QFutureWatcher>
+#include <QVector>
+#include <QColor>
+#include "timeline.h"
+
+/* Lanes are this tall, with their type names in a column on the left */
+#define TIMELINE_LANE_HEIGHT 20
+#define TIMELINE_LABEL_WIDTH 110
+#define TIMELINE_AXIS_HEIGHT 16
+
+/* Closest zoom, enough to see single bus cycles */
+#define TIMELINE_MIN_NS_PER_PIXEL 0.5
+
+/* Shades of lane colour, from a single event up to a busy column */
+#define TIMELINE_SHADES 8
 
 class EventItemModel;
+
+/* The whole capture along a time axis, one lane per event type.  Each
+ * pixel column is one line spanning the entropy range of the events
+ * under it, shaded by how many there are.  Summaries come from a
+ * pyramid built once the file has loaded.
+ */
 class NandView : public QAbstractScrollArea
 {
 	Q_OBJECT
@@ -11,16 +33,48 @@ class NandView : public QAbstractScrollArea
 public:
 	explicit NandView(QWidget *parent = 0);
 	virtual ~NandView();
+
+	void setModel(EventItemModel *model);
 	
 protected:
 	virtual void paintEvent(QPaintEvent *event);
 	virtual void resizeEvent(QResizeEvent *event);
 	virtual void keyPressEvent(QKeyEvent *event);
+	virtual void wheelEvent(QWheelEvent *event);
+	virtual void mousePressEvent(QMouseEvent *event);
+	virtual void scrollContentsBy(int dx, int dy);
+
+signals:
+	void eventClicked(int index);
 
 public Q_SLOTS:
 	void repaint();
+	void setCurrentEvent(int index);
+	void zoomAll();
+
+private Q_SLOTS:
+	void buildTimeline();
+	void gotTimelineBuilt();
 
 private:
+	EventItemModel *_model;
+	struct Timeline _timeline;
+	bool _ready;
+	QFuture<void> _builder;
+	QFutureWatcher<void> _builderWatcher;
+
+	qint64 _viewStart;          // ns after the capture start
+	double _nsPerPixel;
+	int _currentEvent;
+
+	struct TimelineColumns _columns;   // The last view painted
+	QColor _shades[TIMELINE_SHADES];
+
+	void build();
+	void zoom(double factor, int x);
+	double scrollUnit() const;
+	qint64 span() const;
+	int columns() const;
 	void updateScrollbars();
 };
 
@@ -0,0 +1,88 @@
+#include <QtAlgorithms>
+#include "rowindex.h"
+
+/* Rows are 24 bits, sorted a byte at a time */
+#define ROW_BITS 24
+#define RADIX_BITS 8
+#define RADIX_SIZE (1 << RADIX_BITS)
+
+void row_index_build(struct RowIndex &index, const struct EventTable &table, int count)
+{
+	const qint32 *rowColumn = table.row.constData();
+	QVector<quint32> keys, keysTmp;
+	QVector<int> events, eventsTmp;
+	int n = 0;
+	int i, shift;
+
+	for (i = 0; i < count; i++)
+		if (rowColumn[i] >= 0)
+			n++;
+
+	keys.resize(n);
+	events.resize(n);
+	keysTmp.resize(n);
+	eventsTmp.resize(n);
+
+	n = 0;
+	for (i = 0; i < count; i++) {
+		if (rowColumn[i] >= 0) {
+			keys[n] = rowColumn[i];
+			events[n] = i;
+			n++;
+		}
+	}
+
+	/* LSD radix sort.  Each pass is stable, and events start out in file
+	 * order, so each row's events stay in file order.
+	 */
+	for (shift = 0; shift < ROW_BITS; shift += RADIX_BITS) {
+		int offsets[RADIX_SIZE];
+		const quint32 *k = keys.constData();
+		const int *e = events.constData();
+		quint32 *kOut = keysTmp.data();
+		int *eOut = eventsTmp.data();
+		int sum = 0;
+
+		memset(offsets, 0, sizeof(offsets));
+		for (i = 0; i < n; i++)
+			offsets[(k[i] >> shift) & (RADIX_SIZE - 1)]++;
+		for (i = 0; i < RADIX_SIZE; i++) {
+			int c = offsets[i];
+			offsets[i] = sum;
+			sum += c;
+		}
+		for (i = 0; i < n; i++) {
+			int slot = offsets[(k[i] >> shift) & (RADIX_SIZE - 1)]++;
+			kOut[slot] = k[i];
+			eOut[slot] = e[i];
+		}
+
+		keys.swap(keysTmp);
+		events.swap(eventsTmp);
+	}
+
+	index.rows.clear();
+	index.starts.clear();
+	for (i = 0; i < n; i++) {
+		if (!i || keys.at(i) != keys.at(i - 1)) {
+			index.rows.append(keys.at(i));
+			index.starts.append(i);
+		}
+	}
+	index.starts.append(n);
+	index.events = events;
+}
+
+int row_index_find(const struct RowIndex &index, quint32 row, const int **events)
+{
+	QVector<quint32>::const_iterator it = qBinaryFind(index.rows.constBegin(),
+													  index.rows.constEnd(), row);
+	if (it == index.rows.constEnd()) {
+		*events = NULL;
+		return 0;
+	}
+
+	int i = it - index.rows.constBegin();
+	*events = index.events.constData() + index.starts.at(i);
+	return index.starts.at(i + 1) - index.starts.at(i);
+}
@@ -0,0 +1,22 @@
+#ifndef ROWINDEX_H
+#define ROWINDEX_H
+
+#include <QVector>
+#include "eventtable.h"
+
+/* Every event with a NAND address, grouped by row.  Rows are sorted and
+ * each row's events are in file order.
+ */
+struct RowIndex {
+	QVector<quint32> rows;      // Distinct rows
+	QVector<int> starts;        // rows[i] has events[starts[i]] to events[starts[i+1]-1]
+	QVector<int> events;
+};
+
+/* Index the first count events of table */
+void row_index_build(struct RowIndex &index, const struct EventTable &table, int count);
+
+/* Point events at the accesses to row, and return how many there are */
+int row_index_find(const struct RowIndex &index, quint32 row, const int **events);
+
+#endif // ROWINDEX_H
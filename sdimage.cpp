@@ -0,0 +1,113 @@
+#include <QDebug>
+#include <QtConcurrentRun>
+#include "sdimage.h"
+#include "byteswap.h"
+
+SdImageBuilder::SdImageBuilder(const EventStream *events, QObject *parent) :
+	QObject(parent),
+	_events(events),
+	_failed(false),
+	_next(0)
+{
+	connect(&_watcher, SIGNAL(finished()), this, SLOT(gotBatchFinished()));
+}
+
+SdImageBuilder::~SdImageBuilder()
+{
+	_worker.waitForFinished();
+	_image.close();
+}
+
+int SdImageBuilder::start(const QString &fileName)
+{
+	if (isRunning()) {
+		qDebug() << "An SD image is already being built";
+		return -1;
+	}
+
+	if (_image.open(fileName, SD_SECTOR_SIZE))
+		return -1;
+
+	_failed = false;
+	_next = 0;
+	update();
+	return 0;
+}
+
+bool SdImageBuilder::isRunning() const
+{
+	return _image.isOpen();
+}
+
+/* Runs on a worker thread, over events that have finished loading */
+void SdImageBuilder::process(int first, int last)
+{
+	const struct EventTable &table = _events->table();
+	int i;
+
+	for (i = first; i < last; i++) {
+		const struct evt_sd_cmd *sd;
+		const uint8_t *data;
+		uint32_t size, count, sector;
+
+		if (table.type.at(i) != EVT_SD_CMD)
+			continue;
+
+		sd = (const struct evt_sd_cmd *)_events->eventPacket(i, &size);
+		if (!sd || size < offsetof(struct evt_sd_cmd, result))
+			continue;
+		if (sd->cmd != 17 && sd->cmd != 18)
+			continue;
+		if (_ntohl(sd->num_args) < 4)
+			continue;
+
+		sector = (sd->args[0] << 24) | (sd->args[1] << 16)
+			   | (sd->args[2] << 8) | sd->args[3];
+
+		// Only whole blocks; a capture cut mid-block leaves a short tail
+		count = _events->eventPayload(i, &data) / SD_SECTOR_SIZE;
+		if (!count)
+			continue;
+
+		if (_image.write((qint64)sector * SD_SECTOR_SIZE, (const char *)data,
+						 (qint64)count * SD_SECTOR_SIZE)) {
+			_failed = true;
+			return;
+		}
+	}
+}
+
+/* Start on whatever has loaded since the last batch.  Called as events
+ * load, and again as each batch finishes.
+ */
+void SdImageBuilder::update()
+{
+	if (!isRunning() || _worker.isRunning())
+		return;
+
+	if (_failed) {
+		_image.close();
+		emit failed();
+		return;
+	}
+
+	int available = _events->loadedCount();
+	if (_next < available) {
+		_worker = QtConcurrent::run(this, &SdImageBuilder::process, _next, available);
+		_watcher.setFuture(_worker);
+		_next = available;
+		return;
+	}
+
+	if (!_events->isLoading() && _next >= _events->totalCount()) {
+		qint64 sectors = _image.coveredUnits();
+		_image.close();
+		emit finished(sectors);
+	}
+}
+
+void SdImageBuilder::gotBatchFinished()
+{
+	emit progress(_next, _image.coveredUnits());
+	update();
+}
@@ -0,0 +1,53 @@
+#ifndef SDIMAGE_H
+#define SDIMAGE_H
+
+#include <QObject>
+#include <QFuture>
+#include <QFutureWatcher>
+#include "eventstream.h"
+#include "sparseimage.h"
+
+#define SD_SECTOR_SIZE 512
+
+/* Rebuilds the card as the host saw it from single- and multi-block
+ * reads (CMD17 and CMD18).  Each block lands at its sector in a sparse
+ * image, later reads overwriting earlier ones.  Command arguments are
+ * taken as block addresses, as used by SDHC and SDXC cards.
+ *
+ * Events are processed on a worker thread as they finish loading.  The
+ * image is closed, and finished() emitted, once the whole stream is in,
+ * or failed() emitted as soon as a write goes wrong.
+ */
+class SdImageBuilder : public QObject
+{
+	Q_OBJECT
+public:
+	explicit SdImageBuilder(const EventStream *events, QObject *parent = 0);
+	~SdImageBuilder();
+
+	int start(const QString &fileName);
+	bool isRunning() const;
+
+signals:
+	void progress(int events, qint64 sectors);
+	void finished(qint64 sectors);
+	void failed();
+
+public slots:
+	void update();
+
+private slots:
+	void gotBatchFinished();
+
+private:
+	const EventStream *_events;
+	SparseImage _image;
+	bool _failed;               // Set by the worker when a write fails
+	int _next;
+	QFuture<void> _worker;
+	QFutureWatcher<void> _watcher;
+
+	void process(int first, int last);
+};
+
+#endif // SDIMAGE_H
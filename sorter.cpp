@@ -48,6 +48,27 @@ static struct small_hdr *hdrs;
 static int hdr_count;
 
 
+/* Read the header of the event at the current position and skip past
+ * the rest of it.  Events aren't read whole here: multi-block SD reads
+ * can be larger than union evt.
+ */
+static int event_skip_next(struct state *st, struct evt_header *hdr) {
+    int ret = st->fdh->read((char *)hdr, sizeof(*hdr));
+    if (ret < 0) {
+        perror("Couldn't read header");
+        return -1;
+    }
+    if (ret < (int)sizeof(*hdr))
+        return -2;
+    if (_ntohl(hdr->size) < sizeof(*hdr)) {
+        fprintf(stderr, "Event at %lld is too short\n", (long long)(st->fdh->pos() - sizeof(*hdr)));
+        return -1;
+    }
+    if (!st->fdh->seek(st->fdh->pos() + _ntohl(hdr->size) - sizeof(*hdr)))
+        return -2;
+    return 0;
+}
+
 int compare_event_addrs(const void *a1, const void *a2) {
     const struct small_hdr *o1 = (struct small_hdr *)a1;
     const struct small_hdr *o2 = (struct small_hdr *)a2;
@@ -112,7 +133,7 @@ static int st_uninitialized(struct state *st) {
 // Searching for either a NAND block or a sync point
 static int st_scanning(struct state *st) {
     int ret;
-    union evt evt;
+    struct evt_header hdr;
 
     hdr_count = 0;
 	st->fdh->seek(0);
@@ -123,13 +144,13 @@ static int st_scanning(struct state *st) {
             perror("Couldn't seek");
             return 1;
         }
-        ret = event_get_next(st, &evt);
+        ret = event_skip_next(st, &hdr);
         if (ret < 0)
             break;
         hdr_count++;
         hdrs = (struct small_hdr *)realloc(hdrs, hdr_count*sizeof(struct small_hdr));
-        hdrs[hdr_count-1].sec = evt.header.sec_start;
-        hdrs[hdr_count-1].nsec = evt.header.nsec_start;
+        hdrs[hdr_count-1].sec = _ntohl(hdr.sec_start);
+        hdrs[hdr_count-1].nsec = _ntohl(hdr.nsec_start);
         hdrs[hdr_count-1].pos = s;
     }
     qDebug() << "Found" << hdr_count << "headers to sort";
@@ -157,6 +178,7 @@ static int st_write(struct state *st) {
     int jump_offset;
     struct evt_file_header file_header;
     uint32_t offset;
+    QByteArray buffer;
 
     qDebug() << "Writing out...";
 	st->out_fdh->seek(0);
@@ -165,36 +187,40 @@ static int st_write(struct state *st) {
     // Write out the file header
     memset(&file_header, 0, sizeof(file_header));
     memcpy(file_header.magic1, EVENT_HDR_1, strlen(EVENT_HDR_1));
-    file_header.version = _ntohl(1);
+    file_header.version = _htonl(EVENT_FILE_VERSION);
     file_header.count = _htonl(hdr_count);
 	offset += st->out_fdh->write((char *)&file_header, sizeof(file_header));
 
-    // Advance the offset past the jump table
+    // Advance the offset past the jump table and the data signature
     offset += hdr_count*sizeof(offset);
+    offset += strlen(EVENT_HDR_2);
 
     // Read in the jump table entries
 	st->fdh->seek(0);
     for (jump_offset=0; jump_offset<hdr_count; jump_offset++) {
-        union evt evt;
+        struct evt_header hdr;
         uint32_t offset_swab = _htonl(offset);
 		st->out_fdh->write((char *)&offset_swab, sizeof(offset_swab));
 
         st->fdh->seek(hdrs[jump_offset].pos);
-        memset(&evt, 0, sizeof(evt));
-        event_get_next(st, &evt);
-        if (evt.header.size > 32768)
+        if (event_skip_next(st, &hdr) < 0)
             return 1;
-        offset += evt.header.size;
+        offset += _ntohl(hdr.size);
     }
 
-	offset += st->out_fdh->write(EVENT_HDR_2, 4);
+	st->out_fdh->write(EVENT_HDR_2, 4);
 
-    // Now copy over the exact events
+    // Now copy over the exact events, still in file byte order
     for (jump_offset=0; jump_offset<hdr_count; jump_offset++) {
-        union evt evt;
+        struct evt_header hdr;
         st->fdh->seek(hdrs[jump_offset].pos);
-        event_get_next(st, &evt);
-        event_write(st, &evt);
+        if (st->fdh->read((char *)&hdr, sizeof(hdr)) != sizeof(hdr))
+            return 1;
+        buffer.resize(_ntohl(hdr.size));
+        st->fdh->seek(hdrs[jump_offset].pos);
+        if (st->fdh->read(buffer.data(), buffer.size()) != buffer.size())
+            return 1;
+        st->out_fdh->write(buffer);
     }
 
     sstate_set(st, ST_DONE);
@@ -0,0 +1,102 @@
+#include <QDebug>
+#include "sparseimage.h"
+#include "bitmap.h"
+
+SparseImage::SparseImage() :
+	_unitSize(1),
+	_covered(0)
+{
+}
+
+SparseImage::~SparseImage()
+{
+	close();
+}
+
+int SparseImage::open(const QString &fileName, qint64 unitSize)
+{
+	close();
+
+	_file.setFileName(fileName);
+	if (!_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		qDebug() << "Couldn't open image file:" << _file.errorString();
+		return -1;
+	}
+
+	_unitSize = unitSize;
+	_covered = 0;
+	_coverage.clear();
+	return 0;
+}
+
+bool SparseImage::isOpen() const
+{
+	return _file.isOpen();
+}
+
+/* Seeking past the end and writing leaves a hole on filesystems that
+ * support them, so only written data takes up space.
+ */
+int SparseImage::write(qint64 offset, const char *data, qint64 size)
+{
+	qint64 unit;
+
+	if (size <= 0)
+		return 0;
+
+	if (!_file.seek(offset) || _file.write(data, size) != size) {
+		qDebug() << "Couldn't write image data:" << _file.errorString();
+		return -1;
+	}
+
+	for (unit = offset / _unitSize; unit <= (offset + size - 1) / _unitSize; unit++) {
+		if (BITMAP_WORDS(unit + 1) > _coverage.count())
+			_coverage.resize(BITMAP_WORDS(unit + 1));
+		if (!bitmap_test(_coverage, unit)) {
+			bitmap_set(_coverage, unit);
+			_covered++;
+		}
+	}
+	return 0;
+}
+
+int SparseImage::close()
+{
+	if (!_file.isOpen())
+		return 0;
+
+	QFile coverage(_file.fileName() + ".coverage");
+	_file.close();
+
+	if (!coverage.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		qDebug() << "Couldn't open coverage file:" << coverage.errorString();
+		return -1;
+	}
+
+	// One bit per unit, least significant bit first
+	for (int i = 0; i < _coverage.count(); i++) {
+		uint8_t bytes[8];
+		for (int b = 0; b < 8; b++)
+			bytes[b] = _coverage.at(i) >> (b * 8);
+		coverage.write((const char *)bytes, sizeof(bytes));
+	}
+	coverage.close();
+	return 0;
+}
+
+qint64 SparseImage::unitSize() const
+{
+	return _unitSize;
+}
+
+qint64 SparseImage::coveredUnits() const
+{
+	return _covered;
+}
+
+bool SparseImage::isCovered(qint64 unit) const
+{
+	if (BITMAP_WORDS(unit + 1) > _coverage.count())
+		return false;
+	return bitmap_test(_coverage, unit);
+}
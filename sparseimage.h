@@ -0,0 +1,33 @@
+#ifndef SPARSEIMAGE_H
+#define SPARSEIMAGE_H
+
+#include <QFile>
+#include <QVector>
+
+/* An image file written at arbitrary offsets.  Ranges never written are
+ * left as holes.  Coverage is tracked in fixed-size units, one bit each,
+ * and saved next to the image as <image>.coverage on close().
+ */
+class SparseImage
+{
+public:
+	SparseImage();
+	~SparseImage();
+
+	int open(const QString &fileName, qint64 unitSize);
+	bool isOpen() const;
+	int write(qint64 offset, const char *data, qint64 size);
+	int close();
+
+	qint64 unitSize() const;
+	qint64 coveredUnits() const;
+	bool isCovered(qint64 unit) const;
+
+private:
+	QFile _file;
+	qint64 _unitSize;
+	qint64 _covered;
+	QVector<quint64> _coverage;
+};
+
+#endif // SPARSEIMAGE_H
@@ -35,7 +35,7 @@ int TapboardProcessor::processRawFile(QString &rawFileName)
     if (!fileName.endsWith(".tbevent"))
         fileName += ".tbevent";
 
-    progressWindow = new QProgressDialog(QString::fromUtf8("Joining events…"), "Cancel", 0, 4);
+    progressWindow = new QProgressDialog(QString::fromUtf8("Joining events…"), "Cancel", 0, 5);
     progressWindow->setMinimumDuration(0);
     progressWindow->setValue(1);
     progressWindow->setWindowTitle("Importing trace file");
@@ -53,9 +53,11 @@ int TapboardProcessor::processRawFile(QString &rawFileName)
             this, SLOT(gotGroupFinished()));
     connect(tpp, SIGNAL(sortFinished()),
             this, SLOT(gotSortFinished()));
+    connect(tpp, SIGNAL(metricsFinished()),
+            this, SLOT(gotMetricsFinished()));
 
     // Still don't know why this is required, I thought it quit on its own
-    connect(tpp, SIGNAL(sortFinished()),
+    connect(tpp, SIGNAL(metricsFinished()),
             backgroundThread, SLOT(quit()));
 
     tpp->setSourceFilename(rawFileName);
@@ -89,5 +91,11 @@ void TapboardProcessor::gotGroupFinished()
 
 void TapboardProcessor::gotSortFinished()
 {
+    progressWindow->setLabelText("Computing event metrics...");
     progressWindow->setValue(4);
 }
+
+void TapboardProcessor::gotMetricsFinished()
+{
+    progressWindow->setValue(5);
+}
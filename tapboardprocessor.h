@@ -22,6 +22,7 @@ public slots:
     void gotJoinFinished();
     void gotGroupFinished();
     void gotSortFinished();
+    void gotMetricsFinished();
 };
 
 #endif // TAPBOARDPROCESSOR_H
@@ -7,6 +7,7 @@
 #include "event-struct.h"
 #include "byteswap.h"
 #include "nand.h"
+#include "eventmetrics.h"
 
 struct state;
 
@@ -255,6 +256,80 @@ int TapboardProcessorPrivate::sortFile()
 
     qDebug() << "Done sort";
     emit sortFinished();
+    return metricsFile();
+}
+
+int TapboardProcessorPrivate::metricsFile()
+{
+    qDebug() << "Starting metrics";
+
+    // The sorted file is already a usable version 1 capture, so a
+    // failure here only loses the table; always finish the import.
+    int ret = appendMetrics();
+    if (ret)
+        qDebug() << "Leaving output without metadata table";
+    else
+        qDebug() << "Done metrics";
+
+    emit metricsFinished();
     QThread::currentThread()->exit();
+    return ret;
+}
+
+int TapboardProcessorPrivate::appendMetrics()
+{
+    struct evt_file_header file_header;
+    QVector<uint32_t> offsets;
+    QVector<struct evt_metadata> metadata;
+    uint32_t count;
+    uint32_t i;
+
+    // Append a table of derived per-event values, so loading doesn't
+    // have to recompute them.
+    if (!sortedFile->open(QIODevice::ReadWrite)) {
+        qDebug() << "Unable to reopen sorted output file:" << sortedFile->errorString();
+        return -1;
+    }
+
+    qint64 fileSize = sortedFile->size();
+    uchar *base = sortedFile->map(0, fileSize);
+    if (!base) {
+        qDebug() << "Unable to map sorted output file:" << sortedFile->errorString();
+        sortedFile->close();
+        return -1;
+    }
+
+    memcpy(&file_header, base, sizeof(file_header));
+    count = _ntohl(file_header.count);
+    offsets.resize(count);
+    memcpy(offsets.data(), base + sizeof(file_header), count * sizeof(uint32_t));
+    for (i=0; i<count; i++)
+        offsets[i] = _ntohl(offsets[i]);
+
+    event_compute_metrics_all(base, fileSize, offsets, metadata);
+    sortedFile->unmap(base);
+
+    for (i=0; i<count; i++)
+        event_metadata_swap(&metadata[i]);
+
+    qint64 tableSize = count * sizeof(struct evt_metadata);
+    sortedFile->seek(fileSize);
+    if (sortedFile->write((char *)metadata.constData(), tableSize) != tableSize) {
+        qDebug() << "Unable to write metadata table:" << sortedFile->errorString();
+        sortedFile->resize(fileSize);
+        sortedFile->close();
+        return -1;
+    }
+
+    file_header.version = _htonl(EVENT_FILE_VERSION_METADATA);
+    file_header.metadata = _htonl(fileSize);
+    sortedFile->seek(0);
+    if (sortedFile->write((char *)&file_header, sizeof(file_header)) != sizeof(file_header)) {
+        qDebug() << "Unable to update file header:" << sortedFile->errorString();
+        sortedFile->close();
+        return -1;
+    }
+    sortedFile->close();
+
     return 0;
 }
@@ -22,15 +22,19 @@ private:
     QString sourceFilename;
     QString targetFilename;
 
+    int appendMetrics();
+
 public slots:
     int joinFile();
     int groupFile();
     int sortFile();
+    int metricsFile();
 
 signals:
     void joinFinished();
     void groupFinished();
     void sortFinished();
+    void metricsFinished();
 };
 
 
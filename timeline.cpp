@@ -0,0 +1,333 @@
+#include <QtConcurrentMap>
+#include <QThread>
+#include <QtAlgorithms>
+#include "timeline.h"
+
+/* Events are scanned in ranges of this many for the parallel passes */
+#define TIMELINE_RANGE_SIZE 262144
+
+/* Entropy is kept in 1/32 bits per byte, so 8 bits per byte just fits */
+#define ENTROPY_SCALE 32
+
+static inline void bin_add(struct timeline_bin &bin, quint32 count, quint8 min, quint8 max)
+{
+	if (!count)
+		return;
+	if (!bin.count) {
+		bin.min = min;
+		bin.max = max;
+	}
+	else {
+		bin.min = qMin(bin.min, min);
+		bin.max = qMax(bin.max, max);
+	}
+	bin.count += count;
+}
+
+static inline quint8 entropy_level(float entropy)
+{
+	return qBound(0, (int)(entropy * ENTROPY_SCALE), 255);
+}
+
+struct scan_range {
+	const struct EventTable *table;
+	int first;
+	int last;
+	qint64 start;
+	qint64 end;
+	bool sorted;
+	bool seen[256];
+};
+
+static void scan_events(struct scan_range &range)
+{
+	const qint64 *start = range.table->start.constData();
+	const qint64 *end = range.table->end.constData();
+	const quint8 *type = range.table->type.constData();
+
+	memset(range.seen, 0, sizeof(range.seen));
+	range.start = start[range.first];
+	range.end = end[range.first];
+	range.sorted = true;
+	for (int i = range.first; i < range.last; i++) {
+		if (i > range.first && start[i] < start[i - 1])
+			range.sorted = false;
+		range.start = qMin(range.start, start[i]);
+		range.end = qMax(range.end, end[i]);
+		range.seen[type[i]] = true;
+	}
+}
+
+/* With sorted events, each range only touches the bins between its
+ * first and last events, so it fills a window of its own.
+ */
+struct fill_range {
+	const struct EventTable *table;
+	const struct Timeline *timeline;
+	int first;
+	int last;
+	qint64 firstBin;
+	QVector<QVector<struct timeline_bin> > window;
+};
+
+static void fill_events(const struct EventTable &table, const struct Timeline &timeline,
+						int first, int last, qint64 firstBin,
+						QVector<QVector<struct timeline_bin> > &bins)
+{
+	const qint64 *start = table.start.constData();
+	const quint8 *type = table.type.constData();
+	const float *entropy = table.entropy.constData();
+
+	for (int i = first; i < last; i++) {
+		int lane = timeline.laneOf.at(type[i]);
+		qint64 bin = ((start[i] - timeline.start) >> timeline.shift) - firstBin;
+		quint8 level = entropy_level(entropy[i]);
+		bin_add(bins[lane][bin], 1, level, level);
+	}
+}
+
+static void fill_window(struct fill_range &range)
+{
+	fill_events(*range.table, *range.timeline, range.first, range.last,
+				range.firstBin, range.window);
+}
+
+void timeline_build(struct Timeline &timeline, const struct EventTable &table, int count)
+{
+	QVector<struct scan_range> scans;
+	QVector<struct fill_range> fills;
+	int lanes, lane, first, i;
+	qint64 bins;
+
+	timeline.start = timeline.end = 0;
+	timeline.shift = 0;
+	timeline.sorted = true;
+	timeline.types.clear();
+	timeline.laneOf.fill(-1, 256);
+	timeline.levels.clear();
+	if (count <= 0)
+		return;
+
+	// Find the time span, the types present and whether it's sorted
+	for (first = 0; first < count; first += TIMELINE_RANGE_SIZE) {
+		struct scan_range range;
+		range.table = &table;
+		range.first = first;
+		range.last = qMin(first + TIMELINE_RANGE_SIZE, count);
+		scans.append(range);
+	}
+	QtConcurrent::blockingMap(scans, scan_events);
+
+	bool seen[256];
+	memset(seen, 0, sizeof(seen));
+	timeline.start = scans.at(0).start;
+	timeline.end = scans.at(0).end;
+	for (i = 0; i < scans.count(); i++) {
+		const struct scan_range &range = scans.at(i);
+		timeline.start = qMin(timeline.start, range.start);
+		timeline.end = qMax(timeline.end, range.end);
+		if (!range.sorted
+		 || (i > 0 && table.start.at(range.first) < table.start.at(range.first - 1)))
+			timeline.sorted = false;
+		for (int type = 0; type < 256; type++)
+			seen[type] |= range.seen[type];
+	}
+
+	for (int type = 0; type < 256; type++) {
+		if (seen[type]) {
+			timeline.laneOf[type] = timeline.types.count();
+			timeline.types.append(type);
+		}
+	}
+	lanes = timeline.types.count();
+
+	while (((timeline.end - timeline.start) >> timeline.shift) >= TIMELINE_BASE_BINS)
+		timeline.shift++;
+	bins = ((timeline.end - timeline.start) >> timeline.shift) + 1;
+
+	timeline.levels.resize(lanes);
+	for (lane = 0; lane < lanes; lane++) {
+		timeline.levels[lane].resize(1);
+		timeline.levels[lane][0].resize(bins);
+		memset(timeline.levels[lane][0].data(), 0, bins * sizeof(struct timeline_bin));
+	}
+
+	// Fill level 0
+	if (timeline.sorted) {
+		for (first = 0; first < count; first += TIMELINE_RANGE_SIZE) {
+			struct fill_range range;
+			range.table = &table;
+			range.timeline = &timeline;
+			range.first = first;
+			range.last = qMin(first + TIMELINE_RANGE_SIZE, count);
+			range.firstBin = (table.start.at(range.first) - timeline.start) >> timeline.shift;
+			int size = ((table.start.at(range.last - 1) - timeline.start) >> timeline.shift)
+					 - range.firstBin + 1;
+			range.window.resize(lanes);
+			for (lane = 0; lane < lanes; lane++) {
+				range.window[lane].resize(size);
+				memset(range.window[lane].data(), 0, size * sizeof(struct timeline_bin));
+			}
+			fills.append(range);
+		}
+		QtConcurrent::blockingMap(fills, fill_window);
+
+		for (i = 0; i < fills.count(); i++) {
+			const struct fill_range &range = fills.at(i);
+			for (lane = 0; lane < lanes; lane++) {
+				const QVector<struct timeline_bin> &window = range.window.at(lane);
+				struct timeline_bin *out = timeline.levels[lane][0].data() + range.firstBin;
+				for (int bin = 0; bin < window.count(); bin++)
+					bin_add(out[bin], window.at(bin).count, window.at(bin).min, window.at(bin).max);
+			}
+		}
+	}
+	else {
+		QVector<QVector<struct timeline_bin> > level0(lanes);
+		for (lane = 0; lane < lanes; lane++)
+			level0[lane].swap(timeline.levels[lane][0]);
+		fill_events(table, timeline, 0, count, 0, level0);
+		for (lane = 0; lane < lanes; lane++)
+			level0[lane].swap(timeline.levels[lane][0]);
+	}
+
+	// Each level up merges pairs of bins
+	for (lane = 0; lane < lanes; lane++) {
+		QVector<QVector<struct timeline_bin> > &levels = timeline.levels[lane];
+		while (levels.last().count() > 1) {
+			const QVector<struct timeline_bin> &below = levels.last();
+			QVector<struct timeline_bin> level((below.count() + 1) / 2);
+			memset(level.data(), 0, level.count() * sizeof(struct timeline_bin));
+			for (int bin = 0; bin < below.count(); bin++)
+				bin_add(level[bin / 2], below.at(bin).count, below.at(bin).min, below.at(bin).max);
+			levels.append(level);
+		}
+	}
+}
+
+/* Zoomed in closer than level 0, go to the events themselves: one pass
+ * over the events in view, each added to its own lane.  Returns false if
+ * there are too many to be worth it.
+ */
+static bool direct_columns(const struct Timeline &timeline, const struct EventTable &table,
+						   qint64 from, double nsPerColumn, int columns,
+						   struct TimelineColumns &out)
+{
+	const qint64 *starts = table.start.constData();
+	const qint64 *ends = table.end.constData();
+	const quint8 *types = table.type.constData();
+	const float *entropy = table.entropy.constData();
+	qint64 to = from + (qint64)(nsPerColumn * columns);
+	int count = table.count();
+	int first = qLowerBound(starts, starts + count, timeline.start + from) - starts;
+	int last = qLowerBound(starts, starts + count, timeline.start + to) - starts;
+
+	// Catch the event that's still going at the left edge
+	if (first > 0)
+		first--;
+
+	if (last - first > TIMELINE_DIRECT_MAX)
+		return false;
+
+	for (int i = first; i < last; i++) {
+		int lane = timeline.laneOf.at(types[i]);
+		qint64 c0 = (qint64)((starts[i] - timeline.start - from) / nsPerColumn);
+		qint64 c1 = (qint64)((ends[i] - timeline.start - from) / nsPerColumn);
+		quint8 value = entropy_level(entropy[i]);
+		if (lane < 0 || c1 < 0 || c0 >= columns)
+			continue;
+
+		struct timeline_bin *bins = out.lanes[lane].data();
+		for (qint64 c = qMax(c0, (qint64)0); c <= qMin(c1, (qint64)columns - 1); c++)
+			bin_add(bins[c], 1, value, value);
+	}
+	return true;
+}
+
+/* One lane from the coarsest level whose bins still fit in a column */
+static void level_columns(const struct Timeline &timeline, int lane, qint64 from,
+						  double nsPerColumn, int columns, struct timeline_bin *out)
+{
+	const QVector<QVector<struct timeline_bin> > &levels = timeline.levels.at(lane);
+	qint64 to = from + (qint64)(nsPerColumn * columns);
+	int level;
+	qint64 width;
+
+	for (level = 0, width = (qint64)1 << timeline.shift;
+		 level + 1 < levels.count() && width * 2 <= nsPerColumn;
+		 level++, width *= 2)
+		;
+
+	const QVector<struct timeline_bin> &bins = levels.at(level);
+	qint64 bin = qMax((qint64)0, from / width);
+	qint64 lastBin = qMin((qint64)bins.count() - 1, to / width);
+	for (; bin <= lastBin; bin++) {
+		const struct timeline_bin &b = bins.at(bin);
+		qint64 c = (qint64)((bin * width - from) / nsPerColumn);
+		if (b.count && c >= 0 && c < columns)
+			bin_add(out[c], b.count, b.min, b.max);
+	}
+}
+
+void timeline_columns(const struct Timeline &timeline, const struct EventTable &table,
+					  qint64 from, double nsPerColumn, int columns,
+					  struct TimelineColumns &out)
+{
+	int lanes = timeline.types.count();
+	int lane;
+
+	if (!out.lanes.isEmpty() && out.lanes.count() == lanes && out.from == from
+	 && out.nsPerColumn == nsPerColumn && out.columns == columns)
+		return;
+
+	out.from = from;
+	out.nsPerColumn = nsPerColumn;
+	out.columns = columns;
+	out.lanes.resize(lanes);
+	for (lane = 0; lane < lanes; lane++) {
+		out.lanes[lane].resize(columns);
+		memset(out.lanes[lane].data(), 0, columns * sizeof(struct timeline_bin));
+	}
+
+	if (nsPerColumn < ((qint64)1 << timeline.shift) && timeline.sorted
+	 && direct_columns(timeline, table, from, nsPerColumn, columns, out))
+		return;
+
+	for (lane = 0; lane < lanes; lane++)
+		level_columns(timeline, lane, from, nsPerColumn, columns, out.lanes[lane].data());
+}
+
+int timeline_find(const struct Timeline &timeline, const struct EventTable &table,
+				  int lane, qint64 time, qint64 tolerance)
+{
+	const qint64 *starts = table.start.constData();
+	int count = table.count();
+	quint8 type = timeline.types.at(lane);
+	qint64 best = tolerance + 1;
+	int found = -1;
+	int i;
+
+	if (!timeline.sorted)
+		return -1;
+
+	time += timeline.start;
+	i = qLowerBound(starts, starts + count, time - tolerance) - starts;
+	if (i > 0)
+		i--;
+	for (; i < count && starts[i] <= time + tolerance; i++) {
+		qint64 distance;
+		if (table.type.at(i) != type)
+			continue;
+
+		// Inside the event counts as a direct hit
+		if (time >= starts[i] && time <= table.end.at(i))
+			distance = 0;
+		else
+			distance = qAbs(starts[i] - time);
+		if (distance < best) {
+			best = distance;
+			found = i;
+		}
+	}
+	return found;
+}
@@ -0,0 +1,64 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <QVector>
+#include "eventtable.h"
+
+/* Level 0 splits the capture into at most this many bins, each a power
+ * of two nanoseconds wide.  Every level above halves the bin count.
+ */
+#define TIMELINE_BASE_BINS (1 << 17)
+
+/* Zoomed in past level 0, events are summed straight from the table as
+ * long as there are no more than this many in view.
+ */
+#define TIMELINE_DIRECT_MAX (1 << 20)
+
+/* How many events fell in a stretch of time, and the spread of their
+ * entropy in 1/32 bits per byte.
+ */
+struct timeline_bin {
+	quint32 count;
+	quint8 min;
+	quint8 max;
+};
+
+/* A min/max/count pyramid per event type.  Each type that occurs gets
+ * a lane; levels[lane][level] holds that level's bins.
+ */
+struct Timeline {
+	qint64 start;               // Nanoseconds, earliest event start
+	qint64 end;                 // Latest event end
+	int shift;                  // Level 0 bins are 1 << shift ns wide
+	bool sorted;                // Events are in start time order
+	QVector<quint8> types;      // Event type shown in each lane
+	QVector<int> laneOf;        // Lane for each type, -1 if none
+	QVector<QVector<QVector<struct timeline_bin> > > levels;
+};
+
+/* Summarize the first count events of table, in parallel */
+void timeline_build(struct Timeline &timeline, const struct EventTable &table, int count);
+
+/* Every lane summed into pixel columns, for one view */
+struct TimelineColumns {
+	qint64 from;                // ns after the capture start
+	double nsPerColumn;
+	int columns;
+	QVector<QVector<struct timeline_bin> > lanes;
+};
+
+/* Sum up every lane for each of columns pixel columns, starting from ns
+ * after the capture start, nsPerColumn apart.  Nothing is done if out
+ * already holds that view, so clear out.lanes when the timeline changes.
+ */
+void timeline_columns(const struct Timeline &timeline, const struct EventTable &table,
+					  qint64 from, double nsPerColumn, int columns,
+					  struct TimelineColumns &out);
+
+/* The event in lane starting closest to time, within tolerance ns either
+ * side, or -1.
+ */
+int timeline_find(const struct Timeline &timeline, const struct EventTable &table,
+				  int lane, qint64 time, qint64 tolerance);
+
+#endif // TIMELINE_H
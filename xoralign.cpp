@@ -0,0 +1,122 @@
+#include <QtConcurrentMap>
+#include <QVector>
+#include <string.h>
+#include "xoralign.h"
+#include "xorbytes.h"
+#include "entropy.h"
+
+/* Chi-square against a flat distribution is sum(h^2) * 256 / N - N, so
+ * for a fixed buffer size the shift with the largest sum of squared bin
+ * counts wins and the search can stay in integers.
+ *
+ * Shifts s and s + P (P the pattern length) give identical output except
+ * for the P bytes at [s, s + P), which s patterns and s + P leaves alone.
+ * Each residue class mod P is therefore one full histogram followed by a
+ * P-byte update per step, and the classes are independent of each other.
+ */
+struct align_class {
+	const uint8_t *data;
+	int size;
+	const uint8_t *pattern;
+	int patternSize;
+	int shifts;
+	const QAtomicInt *cancel;
+
+	int residue;
+	int best;
+	quint64 bestScore;
+};
+
+static inline quint64 histogram_score(const uint32_t hist[256])
+{
+	quint64 score = 0;
+	for (int i = 0; i < 256; i++)
+		score += (quint64)hist[i] * hist[i];
+	return score;
+}
+
+static void search_class(struct align_class &job)
+{
+	QByteArray scratch((const char *)job.data + job.residue, job.size - job.residue);
+	uint32_t hist[256], head[256];
+	quint64 score;
+	int shift;
+
+	// The residue's first shift, built in full
+	xor_pattern((uint8_t *)scratch.data(), scratch.size(), job.pattern, job.patternSize);
+	byte_histogram((const uint8_t *)scratch.constData(), scratch.size(), hist);
+	byte_histogram(job.data, job.residue, head);
+	for (int i = 0; i < 256; i++)
+		hist[i] += head[i];
+
+	score = histogram_score(hist);
+	job.best = job.residue;
+	job.bestScore = score;
+
+	for (shift = job.residue + job.patternSize; shift < job.shifts; shift += job.patternSize) {
+		int from = shift - job.patternSize;
+
+		if (*job.cancel)
+			return;
+
+		for (int i = 0; i < job.patternSize && from + i < job.size; i++) {
+			uint8_t plain = job.data[from + i];
+			uint8_t patterned = plain ^ job.pattern[i];
+			if (plain == patterned)
+				continue;
+			score -= 2 * (quint64)hist[patterned] - 1;
+			hist[patterned]--;
+			score += 2 * (quint64)hist[plain] + 1;
+			hist[plain]++;
+		}
+
+		if (score > job.bestScore) {
+			job.best = shift;
+			job.bestScore = score;
+		}
+	}
+}
+
+int xor_align_search(const QByteArray &data, const QByteArray &pattern, int shifts,
+					 const QAtomicInt *cancel, struct xor_align_result *result)
+{
+	QVector<struct align_class> classes;
+	int i;
+
+	if (data.isEmpty() || pattern.isEmpty() || shifts <= 0)
+		return -1;
+
+	// At shift == size nothing is patterned; beyond that is the same again
+	shifts = qMin(shifts, data.size() + 1);
+
+	for (i = 0; i < pattern.size() && i < shifts; i++) {
+		struct align_class job;
+		job.data = (const uint8_t *)data.constData();
+		job.size = data.size();
+		job.pattern = (const uint8_t *)pattern.constData();
+		job.patternSize = pattern.size();
+		job.shifts = shifts;
+		job.cancel = cancel;
+		job.residue = i;
+		job.best = i;
+		job.bestScore = 0;
+		classes.append(job);
+	}
+
+	QtConcurrent::blockingMap(classes, search_class);
+	if (*cancel)
+		return -1;
+
+	const struct align_class *best = &classes.at(0);
+	for (i = 1; i < classes.count(); i++) {
+		const struct align_class &job = classes.at(i);
+		if (job.bestScore > best->bestScore
+		 || (job.bestScore == best->bestScore && job.best < best->best))
+			best = &job;
+	}
+
+	double expected = data.size() / 256.0;
+	result->shift = best->best;
+	result->chisq = best->bestScore / expected - data.size();
+	return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef XORALIGN_H
+#define XORALIGN_H
+
+#include <QByteArray>
+#include <QAtomicInt>
+
+/* The best place to start an XOR pattern, judged by how far the byte
+ * distribution of the result is from uniform.
+ */
+struct xor_align_result {
+	int shift;
+	double chisq;
+};
+
+/* Try pattern at every shift in [0, shifts) over data, in parallel.
+ * Shifts past the end of data are pointless and are dropped.  Returns 0
+ * with the highest chi-square, lowest shift first on ties, in result, or
+ * -1 if there is nothing to search or cancel was set part way through.
+ */
+int xor_align_search(const QByteArray &data, const QByteArray &pattern, int shifts,
+					 const QAtomicInt *cancel, struct xor_align_result *result);
+
+#endif // XORALIGN_H
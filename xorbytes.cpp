@@ -0,0 +1,99 @@
+#include <string.h>
+#include "xorbytes.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Payloads are a few kilobytes at most, so the win is in not going a
+ * byte at a time.  SSE2 handles 64 bytes per pass where it's there, and
+ * words pick up whatever is left.  Loads are unaligned; event payloads
+ * sit at arbitrary offsets in the mapped file.
+ */
+void xor_bytes(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	size_t i = 0;
+
+#ifdef __SSE2__
+	for (; i + 64 <= size; i += 64) {
+		__m128i a0 = _mm_loadu_si128((const __m128i *)(dst + i));
+		__m128i a1 = _mm_loadu_si128((const __m128i *)(dst + i + 16));
+		__m128i a2 = _mm_loadu_si128((const __m128i *)(dst + i + 32));
+		__m128i a3 = _mm_loadu_si128((const __m128i *)(dst + i + 48));
+		__m128i b0 = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i b1 = _mm_loadu_si128((const __m128i *)(src + i + 16));
+		__m128i b2 = _mm_loadu_si128((const __m128i *)(src + i + 32));
+		__m128i b3 = _mm_loadu_si128((const __m128i *)(src + i + 48));
+
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(a0, b0));
+		_mm_storeu_si128((__m128i *)(dst + i + 16), _mm_xor_si128(a1, b1));
+		_mm_storeu_si128((__m128i *)(dst + i + 32), _mm_xor_si128(a2, b2));
+		_mm_storeu_si128((__m128i *)(dst + i + 48), _mm_xor_si128(a3, b3));
+	}
+#endif
+
+	for (; i + 8 <= size; i += 8) {
+		uint64_t a, b;
+		memcpy(&a, dst + i, sizeof(a));
+		memcpy(&b, src + i, sizeof(b));
+		a ^= b;
+		memcpy(dst + i, &a, sizeof(a));
+	}
+
+	for (; i < size; i++)
+		dst[i] ^= src[i];
+}
+
+void xor_invert(uint8_t *dst, size_t size)
+{
+	size_t i = 0;
+
+#ifdef __SSE2__
+	const __m128i ones = _mm_set1_epi8((char)0xff);
+	for (; i + 16 <= size; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(dst + i));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(a, ones));
+	}
+#endif
+
+	for (; i + 8 <= size; i += 8) {
+		uint64_t a;
+		memcpy(&a, dst + i, sizeof(a));
+		a = ~a;
+		memcpy(dst + i, &a, sizeof(a));
+	}
+
+	for (; i < size; i++)
+		dst[i] = ~dst[i];
+}
+
+/* Short patterns are unrolled into a block first so the bulk of the
+ * work goes through xor_bytes() rather than a modulo per byte.
+ */
+#define XOR_PATTERN_BLOCK 4096
+
+void xor_pattern(uint8_t *dst, size_t size,
+		const uint8_t *pattern, size_t pattern_size)
+{
+	uint8_t block[XOR_PATTERN_BLOCK];
+	size_t block_size;
+	size_t i;
+
+	if (!pattern_size || !size)
+		return;
+
+	if (pattern_size > XOR_PATTERN_BLOCK) {
+		for (i = 0; i < size; i += pattern_size)
+			xor_bytes(dst + i, pattern,
+					size - i < pattern_size ? size - i : pattern_size);
+		return;
+	}
+
+	/* A whole number of repeats, so every block starts in phase */
+	block_size = (XOR_PATTERN_BLOCK / pattern_size) * pattern_size;
+	for (i = 0; i < block_size; i += pattern_size)
+		memcpy(block + i, pattern, pattern_size);
+
+	for (i = 0; i < size; i += block_size)
+		xor_bytes(dst + i, block, size - i < block_size ? size - i : block_size);
+}
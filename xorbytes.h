@@ -0,0 +1,19 @@
+#ifndef XORBYTES_H
+#define XORBYTES_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* dst ^= src, size bytes */
+void xor_bytes(uint8_t *dst, const uint8_t *src, size_t size);
+
+/* dst = ~dst, size bytes.  XNOR against a buffer is xor_bytes()
+ * followed by this over the same range.
+ */
+void xor_invert(uint8_t *dst, size_t size);
+
+/* dst ^= pattern repeated from its first byte, size bytes */
+void xor_pattern(uint8_t *dst, size_t size,
+		const uint8_t *pattern, size_t pattern_size);
+
+#endif // XORBYTES_H